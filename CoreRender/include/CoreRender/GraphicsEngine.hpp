@@ -31,6 +31,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "scene/Animation.hpp"
 #include "scene/Terrain.hpp"
 #include "render/Mesh.hpp"
+#include "render/OcclusionQuery.hpp"
 
 namespace cr
 {
@@ -99,6 +100,7 @@ namespace cr
 			render::Pipeline::Ptr getPipeline(const std::string name);
 			render::Material::Ptr getMaterial(const std::string name);
 			render::Mesh::Ptr createMesh();
+			render::OcclusionQuery::Ptr createOcclusionQuery();
 
 			/**
 			 * Creates a screenshot with the current screen content.
@@ -167,6 +169,15 @@ namespace cr
 		private:
 			render::VideoDriver *createDriver();
 
+			/**
+			 * Number of frames which are kept for reuse after rendering.
+			 */
+			static const unsigned int FRAME_POOL_SIZE = 3;
+			/**
+			 * Returns a finished frame to the list of reusable frames.
+			 */
+			void recycleFrame(render::FrameData *frame);
+
 			render::UploadManager uploadmgr;
 
 			res::ResourceManager *rmgr;
@@ -191,6 +202,13 @@ namespace cr
 			core::Duration lastrendertime;
 			core::Duration composetime;
 			core::Duration lastcomposetime;
+
+			tbb::mutex framemutex;
+			std::vector<render::FrameData*> freeframes;
+			/**
+			 * Slowly decaying maximum of the memory used by previous frames.
+			 */
+			unsigned int framememory;
 	};
 }
 
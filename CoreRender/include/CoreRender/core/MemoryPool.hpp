@@ -23,7 +23,11 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define _CORERENDER_CORE_MEMORYPOOL_HPP_INCLUDED_
 
 #include <vector>
+#include <cstddef>
+#include <type_traits>
 #include <tbb/spin_mutex.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/cache_aligned_allocator.h>
 
 // Use this to replace the garbage collector with normal malloc()/free() pairs
 // for every allocation to make memory debuggers like valgrind work properly
@@ -54,6 +58,54 @@ namespace cr
 {
 namespace core
 {
+	/**
+	 * Usage statistics of a MemoryPool since the last reset.
+	 */
+	struct MemoryPoolStats
+	{
+		MemoryPoolStats()
+			: allocated(0), usedpages(0), freepages(0), pagesize(0),
+			wasted(0), largestallocation(0), largeallocations(0),
+			destructors(0)
+		{
+		}
+
+		/**
+		 * Sum of the sizes of all allocations (in bytes).
+		 */
+		unsigned int allocated;
+		/**
+		 * Number of pages which are currently in use.
+		 */
+		unsigned int usedpages;
+		/**
+		 * Number of pages which are currently unused and ready for reuse.
+		 */
+		unsigned int freepages;
+		/**
+		 * Size of a single page (in bytes).
+		 */
+		unsigned int pagesize;
+		/**
+		 * Number of bytes left unused at the end of pages and thread chunks
+		 * because an allocation did not fit in there, including the unused
+		 * rest of the current chunk of every thread.
+		 */
+		unsigned int wasted;
+		/**
+		 * Size of the largest single allocation (in bytes).
+		 */
+		unsigned int largestallocation;
+		/**
+		 * Number of allocations which did not fit into a page.
+		 */
+		unsigned int largeallocations;
+		/**
+		 * Number of registered destructors which are called on reset.
+		 */
+		unsigned int destructors;
+	};
+
 
 	/**
 	 * Memory pool class using simple garbage collection. This class can be used
@@ -62,8 +114,9 @@ namespace core
 	 * at the end of the frame. This class allocates all these from larger areas
 	 * of memory to reduce the number of calls to malloc/free and can easily
 	 * reuse the memory after reset() has been called and all objects have been
-	 * deleted. allocate() however is not viable for very large objects, these
-	 * should be allocated in a different way.
+	 * deleted. Objects which do not fit into a single page are placed in
+	 * separate large allocations which are kept for reuse after reset() just
+	 * like pages.
 	 *
 	 * Note that this class only works with POD types which do not have any
 	 * constructor or destructor as the latter is not called when the memory
@@ -71,21 +124,71 @@ namespace core
 	 *
 	 * The memory allocated by this class is divided into large pages, when one
 	 * is full, the next one is allocated and used for many calls to allocate().
+	 * By default allocations are only aligned to pointer size, types which
+	 * need stricter alignment (for example for SIMD loads) should be allocated
+	 * with allocate(size, alignment) or allocateArray().
+	 *
+	 * If many threads allocate from the same pool at once (for example when
+	 * render queues are filled in parallel), the pool can be created in
+	 * thread-local mode. Every thread then gets its own chunk of memory carved
+	 * out of the shared pages and only has to lock the pool when this chunk is
+	 * full.
+	 *
+	 * On Linux, pools which touch a lot of memory every frame can request
+	 * their pages to be backed by huge pages to reduce TLB misses, and can
+	 * request pages to be prefaulted when they are allocated. If no huge pages
+	 * are available, normal pages are used instead.
 	 */
 	class MemoryPool
 	{
 		public:
+			/**
+			 * Flags which control how the pages of the pool are allocated.
+			 */
+			struct PageFlags
+			{
+				enum List
+				{
+					/**
+					 * Normal pages.
+					 */
+					None = 0x0,
+					/**
+					 * Tries to back the pages with huge pages. The page size
+					 * is rounded up to a multiple of the huge page size.
+					 */
+					HugePages = 0x1,
+					/**
+					 * Maps physical memory to the pages at once so that the
+					 * first access does not cause page faults.
+					 */
+					Prefault = 0x2
+				};
+			};
+			/**
+			 * Size of a huge page.
+			 */
+			static const unsigned int HUGE_PAGE_SIZE = 0x200000;
+
 			/**
 			 * Constructor.
 			 * @param pagesize Size of one page allocated by the class. Should
 			 * be much larger than the objects which are going to be allocated.
+			 * @param threadlocal If true, small allocations are served from
+			 * per-thread chunks without locking the pool.
+			 * @param pageflags Combination of PageFlags values.
 			 */
-			MemoryPool(unsigned int pagesize = 1048576)
-				: used(0), firstdestructor(0), lastdestructor(0)
+			MemoryPool(unsigned int pagesize = 1048576,
+			           bool threadlocal = false,
+			           unsigned int pageflags = PageFlags::None)
+				: used(0), firstdestructor(0), lastdestructor(0),
+				threadlocal(threadlocal), pageflags(pageflags), hugepages(0),
+				advisedhugepages(0), allocated(0), largestallocation(0),
+				wasted(0), largeallocations(0), destructorcount(0)
 			{
-				// Round up page size to 4k pages
-				pagesize = (pagesize + 0xFFF) & ~0xFFF;
+				pagesize = roundPageSize(pagesize);
 				this->pagesize = pagesize;
+				chunksize = pagesize / CHUNKS_PER_PAGE;
 				// Allocate a single page
 				currentmemory = allocPage(pagesize);
 
@@ -101,6 +204,7 @@ namespace core
 				// Call destructors
 				callDestructors();
 				// Free memory
+				freeLargeAllocations();
 				freePage(currentmemory, pagesize);
 				for (unsigned int i = 0; i < usedmemory.size(); i++)
 					freePage(usedmemory[i], pagesize);
@@ -123,6 +227,9 @@ namespace core
 			{
 				// Call destructors
 				callDestructors();
+				resetThreadChunks();
+				recycleLargeAllocations();
+				resetStats();
 				// Delete unused free pages
 				for (unsigned int i = 0; i < freememory.size(); i++)
 					freePage(freememory[i], pagesize);
@@ -146,8 +253,13 @@ namespace core
 			void reset(unsigned int size)
 			{
 				unsigned int pagecount = (size + pagesize - 1) / pagesize;
+				if (pagecount == 0)
+					pagecount = 1;
 				// Call destructors
 				callDestructors();
+				resetThreadChunks();
+				recycleLargeAllocations();
+				resetStats();
 				// We have one page in currentmemory
 				pagecount -= 1;
 				// Allocate enough pages, reusing existing pages
@@ -162,10 +274,10 @@ namespace core
 				}
 				else if (freememory.size() + usedmemory.size() >= pagecount)
 				{
-					for (unsigned int i = 0; i < pagecount - freememory.size(); i++)
+					unsigned int reused = pagecount - freememory.size();
+					for (unsigned int i = 0; i < reused; i++)
 						freememory.push_back(usedmemory[i]);
-					for (unsigned int i = pagecount - freememory.size();
-						i < usedmemory.size(); i++)
+					for (unsigned int i = reused; i < usedmemory.size(); i++)
 						freePage(usedmemory[i], pagesize);
 					usedmemory.clear();
 				}
@@ -194,10 +306,12 @@ namespace core
 			 */
 			void reset(unsigned int size, unsigned int pagesize)
 			{
-				// Round up page size to 4k pages
-				pagesize = (pagesize + 0xFFF) & ~0xFFF;
+				pagesize = roundPageSize(pagesize);
 				// Call destructors
 				callDestructors();
+				resetThreadChunks();
+				freeLargeAllocations();
+				resetStats();
 				// Free all existing pages
 				freePage(currentmemory, this->pagesize);
 				for (unsigned int i = 0; i < usedmemory.size(); i++)
@@ -207,6 +321,7 @@ namespace core
 				usedmemory.clear();
 				// Set new page size
 				this->pagesize = pagesize;
+				chunksize = pagesize / CHUNKS_PER_PAGE;
 				// Allocate new pages
 				unsigned int pagecount = (size + pagesize - 1) / pagesize;
 				currentmemory = allocPage(pagesize);
@@ -221,6 +336,78 @@ namespace core
 
 			}
 
+			/**
+			 * Returns the amount of memory which has been taken from the pages
+			 * since the last call to reset(). Large allocations which do not
+			 * fit into a page are not included.
+			 * @return Used memory in bytes.
+			 */
+			unsigned int getUsedSize()
+			{
+				tbb::spin_mutex::scoped_lock lock(mutex);
+				return usedmemory.size() * pagesize + used;
+			}
+
+			/**
+			 * Returns usage statistics of the pool since the last call to
+			 * reset(). This must not be called while other threads are
+			 * allocating memory from the pool.
+			 * @param stats Structure which receives the statistics.
+			 */
+			void getStats(MemoryPoolStats &stats)
+			{
+				tbb::spin_mutex::scoped_lock lock(mutex);
+				stats.allocated = allocated;
+				stats.usedpages = usedmemory.size() + 1;
+				stats.freepages = freememory.size();
+				stats.pagesize = pagesize;
+				stats.wasted = wasted;
+				stats.largestallocation = largestallocation;
+				stats.largeallocations = largeallocations;
+				stats.destructors = destructorcount;
+				ChunkList::iterator it;
+				for (it = chunks.begin(); it != chunks.end(); it++)
+				{
+					stats.allocated += it->allocated;
+					stats.wasted += it->wasted;
+					// The rest of the current chunk is dropped in reset(), so
+					// it is wasted as well
+					if (it->memory)
+						stats.wasted += chunksize - it->used;
+					if (it->largestallocation > stats.largestallocation)
+						stats.largestallocation = it->largestallocation;
+					stats.destructors += it->destructors;
+				}
+			}
+			/**
+			 * Returns the number of huge pages which were reserved with
+			 * MAP_HUGETLB for this pool. These are guaranteed to be huge pages.
+			 * @return Number of reserved huge pages.
+			 */
+			unsigned int getHugePageCount()
+			{
+				return hugepages;
+			}
+			/**
+			 * Returns the number of huge pages for which the kernel was asked
+			 * to use transparent huge pages. The kernel might still back some
+			 * of these with normal pages.
+			 * @return Number of huge pages requested via madvise().
+			 */
+			unsigned int getAdvisedHugePageCount()
+			{
+				return advisedhugepages;
+			}
+
+			/**
+			 * Default alignment of allocate(size).
+			 */
+			static const unsigned int DEFAULT_ALIGNMENT = sizeof(void*);
+			/**
+			 * Alignment needed for aligned SSE loads and stores.
+			 */
+			static const unsigned int SIMD_ALIGNMENT = 16;
+
 			/**
 			 * Allocates a certain amount of memory. The pointer which is
 			 * returned is only valid until reset() is called.
@@ -229,38 +416,52 @@ namespace core
 			 */
 			void *allocate(unsigned int size)
 			{
+				return allocate(size, DEFAULT_ALIGNMENT);
+			}
+			/**
+			 * Allocates a certain amount of memory with a certain alignment.
+			 * The pointer which is returned is only valid until reset() is
+			 * called.
+			 * @param size Size of the memory allocated (in bytes).
+			 * @param alignment Alignment of the returned pointer, has to be a
+			 * power of two and must not be larger than 4096.
+			 * @return Pointer to the allocated memory.
+			 */
+			void *allocate(unsigned int size, unsigned int alignment)
+			{
 #ifndef CR_MEMORY_DEBUGGING
-				// TODO: Handle large allocations properly?
-				tbb::spin_mutex::scoped_lock lock(mutex);
-				if (used + size <= pagesize)
+				if (threadlocal && size + alignment - 1 <= chunksize)
 				{
-					// We have enough memory on this page
-					void *memory = (char*)currentmemory + used;
-					used += size;
+					// Allocate from the chunk of this thread, only lock the
+					// pool if a new chunk has to be fetched
+					ThreadChunk &chunk = chunks.local();
+					unsigned int offset = 0;
+					if (chunk.memory)
+						offset = getPadding(chunk.memory + chunk.used, alignment);
+					if (!chunk.memory || chunk.used + offset + size > chunksize)
+					{
+						if (chunk.memory)
+							chunk.wasted += chunksize - chunk.used;
+						chunk.memory = (char*)allocateShared(chunksize,
+						                                     CHUNK_ALIGNMENT,
+						                                     false);
+						chunk.used = 0;
+						offset = getPadding(chunk.memory, alignment);
+					}
+					void *memory = chunk.memory + chunk.used + offset;
+					chunk.used += offset + size;
+					chunk.allocated += size;
+					if (size > chunk.largestallocation)
+						chunk.largestallocation = size;
 					return memory;
 				}
-				else if (freememory.empty())
-				{
-					// Allocate a new page
-					usedmemory.push_back(currentmemory);
-					currentmemory = allocPage(pagesize);
-					used = size;
-					return currentmemory;
-				}
-				else
-				{
-					// Start a new page
-					usedmemory.push_back(currentmemory);
-					currentmemory = freememory.back();
-					freememory.pop_back();
-					used = size;
-					return currentmemory;
-				}
+				return allocateShared(size, alignment, true);
 #elif defined(CR_MEMORY_TAIL_CHECKING)
 				unsigned int pagecount = (size + 0xfff) / 0x1000;
 				// We have to align the allocated memory at the end of the page to
 				// catch tail overwriting errors
 				unsigned int pageoffset = pagecount * 0x1000 - size;
+				pageoffset &= ~(alignment - 1);
 				char *pages = (char*)VirtualAlloc(0,
 				                     (pagecount + 1) * 0x1000,
 				                     MEM_RESERVE,
@@ -275,6 +476,7 @@ namespace core
 				mallocentry->address = pages;
 				mallocentry->pagecount = pagecount + 1;
 				tbb::spin_mutex::scoped_lock lock(mutex);
+				countAllocation(size);
 				if (!mallocmem)
 					mallocentry->next = 0;
 				else
@@ -282,17 +484,34 @@ namespace core
 				mallocmem = mallocentry;
 				return pages + pageoffset;
 #else
-				void *ptr = malloc(size + sizeof(MallocEntry));
+				void *ptr = malloc(size + sizeof(MallocEntry) + alignment - 1);
 				MallocEntry *mallocentry = (MallocEntry*)ptr;
 				tbb::spin_mutex::scoped_lock lock(mutex);
+				countAllocation(size);
 				if (!mallocmem)
 					mallocentry->next = 0;
 				else
 					mallocentry->next = mallocmem;
 				mallocmem = mallocentry;
-				return (char*)ptr + sizeof(MallocEntry);
+				char *memory = (char*)ptr + sizeof(MallocEntry);
+				return memory + getPadding(memory, alignment);
 #endif
 			}
+			/**
+			 * Allocates an array of objects. Like with allocate(), no
+			 * constructors or destructors are called.
+			 * @param count Number of array elements.
+			 * @param alignment Alignment of the array. If 0, the natural
+			 * alignment of T is used.
+			 * @return Pointer to the first array element.
+			 */
+			template<class T> T *allocateArray(unsigned int count,
+			                                   unsigned int alignment = 0)
+			{
+				if (alignment < std::alignment_of<T>::value)
+					alignment = std::alignment_of<T>::value;
+				return (T*)allocate(sizeof(T) * count, alignment);
+			}
 		private:
 			struct DestructorEntry
 			{
@@ -320,21 +539,27 @@ namespace core
 			 */
 			template<class T> void *allocate(bool calldestructor = true)
 			{
+				unsigned int alignment = std::alignment_of<T>::value;
+				if (alignment < DEFAULT_ALIGNMENT)
+					alignment = DEFAULT_ALIGNMENT;
 				// If no destructor call is wanted, just allocate the memory
 				if (!calldestructor)
 				{
-					return allocate(sizeof(T));
+					return allocate(sizeof(T), alignment);
 				}
 				// If a destructor call is wanted, allocate an extra destructor
-				// list entry
-				void *ptr = allocate(sizeof(DestructorEntry) + sizeof(T));
+				// list entry, the object is placed behind it with the correct
+				// alignment
+				unsigned int headersize = (sizeof(DestructorEntry) + alignment - 1)
+				                        & ~(alignment - 1);
+				void *ptr = allocate(headersize + sizeof(T), alignment);
 				DestructorEntry *destructor = (DestructorEntry*)ptr;
 				destructor->callDestructor = callDestructor<T>;
-				destructor->ptr = (char*)ptr + sizeof(DestructorEntry);
+				destructor->ptr = (char*)ptr + headersize;
 				destructor->next = 0;
 				insertDestructor(destructor);
 				// Return memory
-				return (char*)ptr + sizeof(DestructorEntry);
+				return (char*)ptr + headersize;
 			}
 
 			template<class T> void registerDestructor(T *object)
@@ -348,28 +573,214 @@ namespace core
 				insertDestructor(destructor);
 			}
 		private:
-			static void *allocPage(unsigned int size);
+			/**
+			 * Number of per-thread chunks which fit into one page in
+			 * thread-local mode.
+			 */
+			static const unsigned int CHUNKS_PER_PAGE = 16;
+			/**
+			 * Alignment of per-thread chunks. Chunks are cache line aligned so
+			 * that different threads never write to the same cache line.
+			 */
+			static const unsigned int CHUNK_ALIGNMENT = 64;
+
+			/**
+			 * Memory for an allocation which did not fit into a single page.
+			 */
+			struct LargeAllocation
+			{
+				void *memory;
+				unsigned int size;
+			};
+
+			struct ThreadChunk
+			{
+				ThreadChunk()
+					: memory(0), used(0), firstdestructor(0), lastdestructor(0),
+					allocated(0), largestallocation(0), wasted(0), destructors(0)
+				{
+				}
+
+				char *memory;
+				unsigned int used;
+
+				DestructorEntry *firstdestructor;
+				DestructorEntry *lastdestructor;
+
+				unsigned int allocated;
+				unsigned int largestallocation;
+				unsigned int wasted;
+				unsigned int destructors;
+			};
+
+			/**
+			 * Per-thread chunk list. Every chunk is cache aligned so that
+			 * threads do not write into the same cache line, and a native TLS
+			 * key is used to make the lookup in allocate() cheap.
+			 */
+			typedef tbb::enumerable_thread_specific<ThreadChunk,
+			                                        tbb::cache_aligned_allocator<ThreadChunk>,
+			                                        tbb::ets_key_per_instance> ChunkList;
+
+			unsigned int roundPageSize(unsigned int size)
+			{
+				// Round up page size to 4k pages or to huge pages
+				if (pageflags & PageFlags::HugePages)
+					return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+				return (size + 0xFFF) & ~0xFFF;
+			}
+			void *allocPage(unsigned int size);
 			static void freePage(void *page, unsigned int size);
 
+			void *allocateShared(unsigned int size,
+			                     unsigned int alignment,
+			                     bool count)
+			{
+				tbb::spin_mutex::scoped_lock lock(mutex);
+				if (count)
+					countAllocation(size);
+				if (size + alignment - 1 > pagesize)
+				{
+					// The allocation does not fit into a single page, so we
+					// use a separate memory area, reusing the smallest one
+					// which was freed in reset() and is large enough
+					unsigned int largesize = (size + alignment - 1 + 0xFFF) & ~0xFFF;
+					unsigned int best = freelargememory.size();
+					for (unsigned int i = 0; i < freelargememory.size(); i++)
+					{
+						if (freelargememory[i].size >= largesize
+						 && (best == freelargememory.size()
+						  || freelargememory[i].size < freelargememory[best].size))
+							best = i;
+					}
+					LargeAllocation allocation;
+					if (best != freelargememory.size())
+					{
+						allocation = freelargememory[best];
+						freelargememory[best] = freelargememory.back();
+						freelargememory.pop_back();
+					}
+					else
+					{
+						allocation.size = largesize;
+						allocation.memory = allocPage(allocation.size);
+					}
+					largememory.push_back(allocation);
+					largeallocations++;
+					char *memory = (char*)allocation.memory;
+					return memory + getPadding(memory, alignment);
+				}
+				unsigned int offset = getPadding((char*)currentmemory + used,
+				                                 alignment);
+				if (used + offset + size <= pagesize)
+				{
+					// We have enough memory on this page
+					void *memory = (char*)currentmemory + used + offset;
+					used += offset + size;
+					return memory;
+				}
+				wasted += pagesize - used;
+				if (freememory.empty())
+				{
+					// Allocate a new page
+					usedmemory.push_back(currentmemory);
+					currentmemory = allocPage(pagesize);
+				}
+				else
+				{
+					// Start a new page
+					usedmemory.push_back(currentmemory);
+					currentmemory = freememory.back();
+					freememory.pop_back();
+				}
+				offset = getPadding((char*)currentmemory, alignment);
+				used = offset + size;
+				return (char*)currentmemory + offset;
+			}
+			void countAllocation(unsigned int size)
+			{
+				allocated += size;
+				if (size > largestallocation)
+					largestallocation = size;
+			}
+			void resetStats()
+			{
+				allocated = 0;
+				largestallocation = 0;
+				wasted = 0;
+				largeallocations = 0;
+				destructorcount = 0;
+			}
+			static unsigned int getPadding(char *memory, unsigned int alignment)
+			{
+				return (alignment - ((std::size_t)memory & (alignment - 1)))
+				       & (alignment - 1);
+			}
+
+			void recycleLargeAllocations()
+			{
+				// Delete the areas which were not reused since the last
+				// reset and keep the used ones for the next frame
+				for (unsigned int i = 0; i < freelargememory.size(); i++)
+					freePage(freelargememory[i].memory, freelargememory[i].size);
+				freelargememory = largememory;
+				largememory.clear();
+			}
+			void freeLargeAllocations()
+			{
+				for (unsigned int i = 0; i < largememory.size(); i++)
+					freePage(largememory[i].memory, largememory[i].size);
+				largememory.clear();
+				for (unsigned int i = 0; i < freelargememory.size(); i++)
+					freePage(freelargememory[i].memory, freelargememory[i].size);
+				freelargememory.clear();
+			}
+
 			void insertDestructor(DestructorEntry *destructor)
 			{
+				if (threadlocal)
+				{
+					// Every thread has its own destructor list, so we do not
+					// need to lock here
+					ThreadChunk &chunk = chunks.local();
+					appendDestructor(chunk.firstdestructor,
+					                 chunk.lastdestructor,
+					                 destructor);
+					chunk.destructors++;
+					return;
+				}
 				// Insert destructor into the destructor list
 				tbb::spin_mutex::scoped_lock lock(mutex);
-				if (!lastdestructor)
+				destructorcount++;
+				appendDestructor(firstdestructor, lastdestructor, destructor);
+			}
+			static void appendDestructor(DestructorEntry *&first,
+			                             DestructorEntry *&last,
+			                             DestructorEntry *destructor)
+			{
+				if (!last)
 				{
-					firstdestructor = destructor;
-					lastdestructor = destructor;
+					first = destructor;
+					last = destructor;
 				}
 				else
 				{
-					lastdestructor->next = destructor;
-					lastdestructor = destructor;
+					last->next = destructor;
+					last = destructor;
 				}
 			}
 
 			void callDestructors()
 			{
-				DestructorEntry *destructor = firstdestructor;
+				callDestructors(firstdestructor, lastdestructor);
+				ChunkList::iterator it;
+				for (it = chunks.begin(); it != chunks.end(); it++)
+					callDestructors(it->firstdestructor, it->lastdestructor);
+			}
+			static void callDestructors(DestructorEntry *&first,
+			                            DestructorEntry *&last)
+			{
+				DestructorEntry *destructor = first;
 				// Call all destructors
 				while (destructor)
 				{
@@ -377,8 +788,24 @@ namespace core
 					destructor = destructor->next;
 				}
 				// Empty destructor list
-				firstdestructor = 0;
-				lastdestructor = 0;
+				first = 0;
+				last = 0;
+			}
+
+			void resetThreadChunks()
+			{
+				// The chunks point into pages which are reused now, so every
+				// thread has to fetch a new chunk
+				ChunkList::iterator it;
+				for (it = chunks.begin(); it != chunks.end(); it++)
+				{
+					it->memory = 0;
+					it->used = 0;
+					it->allocated = 0;
+					it->largestallocation = 0;
+					it->wasted = 0;
+					it->destructors = 0;
+				}
 			}
 
 			unsigned int pagesize;
@@ -391,9 +818,25 @@ namespace core
 
 			std::vector<void*> usedmemory;
 			std::vector<void*> freememory;
+			std::vector<LargeAllocation> largememory;
+			std::vector<LargeAllocation> freelargememory;
 
 			tbb::spin_mutex mutex;
 
+			bool threadlocal;
+			unsigned int chunksize;
+			ChunkList chunks;
+
+			unsigned int pageflags;
+			unsigned int hugepages;
+			unsigned int advisedhugepages;
+
+			unsigned int allocated;
+			unsigned int largestallocation;
+			unsigned int wasted;
+			unsigned int largeallocations;
+			unsigned int destructorcount;
+
 #ifdef CR_MEMORY_DEBUGGING
 			MallocEntry *mallocmem;
 
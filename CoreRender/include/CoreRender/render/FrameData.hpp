@@ -25,12 +25,16 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "FrameBuffer.hpp"
 #include "Material.hpp"
 #include "Mesh.hpp"
+#include "SortMode.hpp"
+#include "Frustum.hpp"
+#include "OcclusionQuery.hpp"
 #include "../core/MemoryPool.hpp"
 #include "CoreRender/core/Time.hpp"
 
 #include <GameMath.hpp>
 #include <tbb/spin_mutex.h>
 #include <tbb/mutex.h>
+#include <tbb/atomic.h>
 #include <cstring>
 #include <cstdlib>
 
@@ -46,10 +50,19 @@ namespace render
 	struct ShaderCombination;
 	class RenderTarget;
 	struct RenderTargetInfo;
+	class OcclusionBuffer;
 
+	/**
+	 * Custom uniform value of a batch. Batches usually share the uniform
+	 * arrays created by Material::getUniformSnapshot(), so the values must not
+	 * be modified.
+	 */
 	struct CustomUniform
 	{
-		char *name;
+		/**
+		 * Uniform handle as returned by res::NameRegistry::getUniform().
+		 */
+		unsigned int name;
 		unsigned int size;
 		float *data;
 	};
@@ -73,8 +86,10 @@ namespace render
 		CustomUniform *customuniforms;
 
 		// Used for optimization (front-to-back, back-to-front or state change
-		// sorting)
-		float sortkey;
+		// sorting), computed in FrameData::optimize()
+		math::uint64 sortkey;
+		// View space depth of the origin of the batch
+		float depth;
 
 		// Skinning
 		float *skinmat;
@@ -82,6 +97,10 @@ namespace render
 		// Instancing
 		unsigned int transmatcount;
 		math::Mat4f *transmatlist;
+		// Inverse transposed transformation matrices for the normals (one
+		// for every entry in transmatlist or one for transmat), computed in
+		// FrameData::optimize() if the shader needs them, otherwise 0
+		math::Mat4f *normalmat;
 
 		// Scissor rect (only used when non-null, mostly used for 2d rendering)
 		ScissorRect *scissor;
@@ -95,6 +114,8 @@ namespace render
 			RenderQueue,
 			BindTextures,
 			DrawQuad,
+			DrawQuads,
+			OcclusionQueries,
 		};
 	};
 	struct TextureBinding
@@ -110,21 +131,150 @@ namespace render
 		math::Mat4f shadowmat;
 		Texture *shadowmap;
 	};
+	/**
+	 * Single quad drawn as part of a DrawQuads command.
+	 */
+	struct QuadInstance
+	{
+		/**
+		 * Coordinates of the quad in screen space, coordinate values are in
+		 * the range -1..1.
+		 */
+		float quad[4];
+		LightUniforms *light;
+	};
 	struct CameraUniforms
 	{
 		math::Mat4f viewmat;
 		math::Mat4f projmat;
 		math::Vec3f viewer;
 	};
+	/**
+	 * Part of the list of batches which one thread added to a render queue.
+	 */
+	struct BatchChunk
+	{
+		static const unsigned int SIZE = 62;
+
+		BatchChunk *next;
+		unsigned int count;
+		Batch *batches[SIZE];
+	};
+	/**
+	 * List of batches which one thread added to a render queue. The lists are
+	 * padded to a cache line so that threads never write to the same line.
+	 */
+	struct BatchChunkList
+	{
+		BatchChunk *first;
+		BatchChunk *last;
+		unsigned int count;
+		char padding[64 - 2 * sizeof(BatchChunk*) - sizeof(unsigned int)];
+	};
 	struct RenderQueue
 	{
 		RenderQueue()
+			: occlusion(0), occlusionquery(0), requestqueries(false),
+			batches(0), batchcount(0), threadbatches(0),
+			sortmode(SortMode::State), memory(0)
+		{
+		}
+
+		/**
+		 * Number of per-thread batch lists of a queue. Threads with a higher
+		 * slot share the last list and have to lock it.
+		 */
+		static const unsigned int MAX_THREAD_SLOTS = 64;
+
+		/**
+		 * Sets the memory pool of the queue and allocates the per-thread
+		 * batch lists from it. Has to be called before addBatch().
+		 */
+		void setMemory(core::MemoryPool *memory)
+		{
+			this->memory = memory;
+			threadbatches = memory->allocateArray<BatchChunkList>(MAX_THREAD_SLOTS,
+			                                                      64);
+			memset(threadbatches, 0, sizeof(BatchChunkList) * MAX_THREAD_SLOTS);
+		}
+		/**
+		 * Adds a batch to the render queue. This can be called from many
+		 * threads at once without any locking as every thread fills its own
+		 * list of batches. The lists are merged in mergeBatches().
+		 */
+		void addBatch(Batch *batch)
+		{
+			unsigned int slot = getThreadSlot();
+			if (slot < MAX_THREAD_SLOTS - 1)
+			{
+				appendBatch(threadbatches[slot], batch);
+				return;
+			}
+			tbb::spin_mutex::scoped_lock lock(overflowmutex);
+			appendBatch(threadbatches[MAX_THREAD_SLOTS - 1], batch);
+		}
+		/**
+		 * Merges the batches added by all threads into the batches array.
+		 * The lists are appended in the order of the thread slots, so
+		 * SortMode::None only keeps the submission order of the batches
+		 * added by the same thread. This must not be called while batches
+		 * are being added.
+		 */
+		void mergeBatches()
+		{
+			if (!threadbatches)
+				return;
+			unsigned int count = batchcount;
+			for (unsigned int i = 0; i < MAX_THREAD_SLOTS; i++)
+				count += threadbatches[i].count;
+			if (count == batchcount)
+				return;
+			Batch **merged = memory->allocateArray<Batch*>(count);
+			for (unsigned int i = 0; i < batchcount; i++)
+				merged[i] = batches[i];
+			for (unsigned int i = 0; i < MAX_THREAD_SLOTS; i++)
+			{
+				BatchChunk *chunk = threadbatches[i].first;
+				while (chunk)
+				{
+					for (unsigned int j = 0; j < chunk->count; j++)
+						merged[batchcount + j] = chunk->batches[j];
+					batchcount += chunk->count;
+					chunk = chunk->next;
+				}
+			}
+			batches = merged;
+			memset(threadbatches, 0, sizeof(BatchChunkList) * MAX_THREAD_SLOTS);
+		}
+		/**
+		 * Returns the index of the per-thread batch list of the calling
+		 * thread. Slots are handed out once per thread, so a thread uses the
+		 * same slot in every queue and every frame.
+		 */
+		static unsigned int getThreadSlot();
+		void appendBatch(BatchChunkList &list, Batch *batch)
 		{
-			// TODO: Resize batches?
+			BatchChunk *chunk = list.last;
+			if (!chunk || chunk->count == BatchChunk::SIZE)
+			{
+				void *ptr = memory->allocate(sizeof(BatchChunk));
+				chunk = (BatchChunk*)ptr;
+				chunk->next = 0;
+				chunk->count = 0;
+				if (list.last)
+					list.last->next = chunk;
+				else
+					list.first = chunk;
+				list.last = chunk;
+			}
+			chunk->batches[chunk->count] = batch;
+			chunk->count++;
+			list.count++;
 		}
 
 		Batch *prepareBatch(Material *material,
 		                    Mesh *mesh,
+		                    const math::Mat4f &transmat,
 		                    bool instancing = false,
 		                    bool skinning = false)
 		{
@@ -149,43 +299,82 @@ namespace render
 			batch->mesh = mesh;
 			batch->shader = shader;
 			batch->material = material;
+			batch->transmat = transmat;
 			batch->transmatcount = 0;
+			batch->normalmat = 0;
 			batch->skinmat = 0;
 			batch->skinmatcount = 0;
-			// TODO: Sorting
-			batch->sortkey = 0.0f;
-			// Custom uniforms
-			const std::vector<render::Material::UniformInfo> &uniforms = material->getUniforms();
-			batch->customuniformcount = uniforms.size();
-			if (uniforms.size() > 0)
-			{
-				ptr = memory->allocate(sizeof(render::CustomUniform) * uniforms.size());
-				render::CustomUniform *uniformdata = (render::CustomUniform*)ptr;
-				for (unsigned int i = 0; i < uniforms.size(); i++)
-				{
-					uniformdata[i].size = uniforms[i].size;
-					uniformdata[i].data = (float*)memory->allocate(sizeof(float) * uniforms[i].size);
-					std::memcpy(uniformdata[i].data,
-					            uniforms[i].data,
-					            uniforms[i].size * sizeof(float));
-					uniformdata[i].name = (char*)memory->allocate(uniforms[i].name.length() + 1);
-					std::strcpy(uniformdata[i].name, uniforms[i].name.c_str());
-				}
-				batch->customuniforms = uniformdata;
-			}
-			else
-				batch->customuniforms = 0;
+			batch->sortkey = 0;
+			batch->depth = getDepth(transmat);
+			// Custom uniforms (shared by all batches using the material)
+			batch->customuniforms = material->getUniformSnapshot(memory,
+			                                                     frameid,
+			                                                     batch->customuniformcount);
 			// Scissors
 			batch->scissor = 0;
 			return batch;
 		}
+		/**
+		 * Returns the view space depth of the origin of a transformation
+		 * matrix, which is used to sort the batches.
+		 */
+		float getDepth(const math::Mat4f &transmat)
+		{
+			// The camera looks along the negative z axis
+			const math::Mat4f &viewmat = camera->viewmat;
+			return -(viewmat.m[2] * transmat.m[12]
+			       + viewmat.m[6] * transmat.m[13]
+			       + viewmat.m[10] * transmat.m[14]
+			       + viewmat.m[14]);
+		}
 
 		unsigned int context;
+		/**
+		 * ID of the frame this queue belongs to, see FrameData::getFrameId().
+		 */
+		unsigned int frameid;
 		CameraUniforms *camera;
-		math::Frustum clipping[2];
-		std::vector<Batch*> batches;
-		tbb::mutex batchmutex;
-		// TODO: Sort order
+		/**
+		 * View frustum of the queue. Geometry outside of the frustum does not
+		 * need to be added to the queue.
+		 */
+		Frustum clipping;
+		/**
+		 * Software depth buffer containing the occluders as seen from the
+		 * camera of this queue, or 0 if no occlusion culling is done.
+		 */
+		const OcclusionBuffer *occlusion;
+		/**
+		 * Hardware occlusion queries of the camera of this queue, or 0.
+		 * Objects which were hidden in their last query do not need to be
+		 * added to the queue.
+		 */
+		OcclusionQuery *occlusionquery;
+		/**
+		 * True if new occlusion queries shall be requested for the objects
+		 * of this queue. Only set for one queue of every camera.
+		 */
+		bool requestqueries;
+		/**
+		 * Batches in this queue. Only valid after mergeBatches() has been
+		 * called.
+		 */
+		Batch **batches;
+		unsigned int batchcount;
+		/**
+		 * Per-thread batch lists, allocated from the frame memory pool and
+		 * indexed by getThreadSlot().
+		 */
+		BatchChunkList *threadbatches;
+		/**
+		 * Lock for the last batch list which is shared by all threads
+		 * beyond MAX_THREAD_SLOTS - 1.
+		 */
+		tbb::spin_mutex overflowmutex;
+		/**
+		 * Order in which the batches are drawn.
+		 */
+		SortMode::List sortmode;
 		/**
 		 * Memory manager which is used for this render queue. We need this here
 		 * so that we do not have an additional dependency on the FrameData
@@ -232,6 +421,30 @@ namespace render
 				CameraUniforms *camera;
 				LightUniforms *light;
 			} drawquad;
+			struct
+			{
+				/**
+				 * Quads which are drawn with a single instanced draw call.
+				 * The light parameters of the quads are passed to the shader
+				 * as attributes instead of uniforms.
+				 */
+				QuadInstance *quads;
+				unsigned int quadcount;
+				ShaderCombination *shader;
+				Material *material;
+				CameraUniforms *camera;
+			} drawquads;
+			struct
+			{
+				/**
+				 * Bounding boxes which are drawn with an occlusion query
+				 * each. The results are used in one of the next frames.
+				 */
+				OcclusionQuery *query;
+				OcclusionQuery::Request *requests;
+				unsigned int count;
+				CameraUniforms *camera;
+			} occlusionqueries;
 		};
 		RenderCommand *next;
 	};
@@ -307,15 +520,93 @@ namespace render
 	{
 		public:
 			FrameData(core::MemoryPool *memory)
-				: memory(memory)
+				: memory(memory), statechanges(0), unsortedstatechanges(0),
+				mergedbatches(0)
+			{
+				occlusionculled = 0;
+				frameid = getNextFrameId();
+				composestarttime = core::Time::Now();
+			}
+
+			/**
+			 * Prepares the frame data for reuse in a new frame. The memory pool
+			 * has to be reset separately.
+			 */
+			void reset()
 			{
+				scenes.clear();
+				statechanges = 0;
+				unsortedstatechanges = 0;
+				mergedbatches = 0;
+				occlusionculled = 0;
+				frameid = getNextFrameId();
 				composestarttime = core::Time::Now();
 			}
 
 			/**
-			 * Sorts all batches to maximize rendering performance.
+			 * Sorts all batches to maximize rendering performance. Every batch
+			 * gets a 64 bit key built from the blend mode, the shader, the
+			 * material, the mesh and the depth of the batch depending on the
+			 * sort mode of the render queue, and the batches of all render
+			 * queues are sorted by this key in parallel.
+			 *
+			 * Afterwards, in queues sorted by state, runs of batches which only
+			 * differ in their transformation matrix are merged into single
+			 * batches using the instancing variant of their shader. Finally,
+			 * the normal matrices of all batches which need them are computed
+			 * so that the render thread only has to upload them.
 			 */
 			void optimize();
+			/**
+			 * Returns the number of shader, material and mesh changes between
+			 * consecutive batches after optimize() has been called.
+			 */
+			unsigned int getStateChangeCount()
+			{
+				return statechanges;
+			}
+			/**
+			 * Returns the number of shader, material and mesh changes between
+			 * consecutive batches before optimize() sorted them.
+			 */
+			unsigned int getUnsortedStateChangeCount()
+			{
+				return unsortedstatechanges;
+			}
+			/**
+			 * Returns the number of batches which optimize() removed by merging
+			 * them into instanced batches.
+			 */
+			unsigned int getMergedBatchCount()
+			{
+				return mergedbatches;
+			}
+			/**
+			 * Adds objects which were skipped because of the results of
+			 * hardware occlusion queries. Can be called by multiple threads
+			 * at once.
+			 */
+			void addOcclusionCulledCount(unsigned int count)
+			{
+				occlusionculled += count;
+			}
+			/**
+			 * Returns the number of objects which were skipped because of
+			 * the results of hardware occlusion queries.
+			 */
+			unsigned int getOcclusionCulledCount()
+			{
+				return occlusionculled;
+			}
+
+			/**
+			 * Returns an ID which is unique for every frame, even if the frame
+			 * data is reused. This is never 0.
+			 */
+			unsigned int getFrameId()
+			{
+				return frameid;
+			}
 
 			void addScene(SceneFrameData *scene)
 			{
@@ -349,7 +640,10 @@ namespace render
 				return composeendtime;
 			}
 	private:
+			static unsigned int getNextFrameId();
+
 			core::MemoryPool *memory;
+			unsigned int frameid;
 			UploadLists upload;
 			std::vector<SceneFrameData*> scenes;
 			// TODO: Try tbb::mutex here
@@ -357,6 +651,11 @@ namespace render
 
 			core::Time composestarttime;
 			core::Time composeendtime;
+
+			unsigned int statechanges;
+			unsigned int unsortedstatechanges;
+			unsigned int mergedbatches;
+			tbb::atomic<unsigned int> occlusionculled;
 	};
 }
 }
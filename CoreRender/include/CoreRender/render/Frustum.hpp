@@ -0,0 +1,155 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _CORERENDER_RENDER_FRUSTUM_HPP_INCLUDED_
+#define _CORERENDER_RENDER_FRUSTUM_HPP_INCLUDED_
+
+#include <GameMath.hpp>
+
+namespace cr
+{
+namespace render
+{
+	/**
+	 * View frustum described by six planes, used to cull geometry which is
+	 * not visible to a render queue. A frustum which has not been set up
+	 * with setMatrix() does not cull anything.
+	 */
+	class Frustum
+	{
+		public:
+			/**
+			 * Constructor. Creates a frustum which does not cull anything.
+			 */
+			Frustum()
+				: enabled(false)
+			{
+			}
+
+			/**
+			 * Extracts the frustum planes from a view-projection matrix.
+			 * @param viewproj Projection matrix multiplied with the view
+			 * matrix.
+			 */
+			void setMatrix(const math::Mat4f &viewproj);
+			/**
+			 * Disables the frustum, afterwards nothing is culled anymore.
+			 */
+			void disable()
+			{
+				enabled = false;
+			}
+			/**
+			 * Returns true if the frustum was set up with setMatrix().
+			 */
+			bool isEnabled() const
+			{
+				return enabled;
+			}
+
+			/**
+			 * Checks whether a bounding box is at least partially visible.
+			 * @param box Bounding box in object space.
+			 * @param transmat Transformation from object to world space.
+			 * @return False if the box lies completely outside of the frustum.
+			 */
+			bool isVisible(const math::BoundingBox &box,
+			               const math::Mat4f &transmat) const;
+			/**
+			 * Checks whether a world space bounding box is at least partially
+			 * visible, used for hierarchical culling.
+			 * @param box Bounding box in world space.
+			 * @param planemask Bit mask of the planes which have to be tested,
+			 * start with ALL_PLANES. The bits of the planes which the box
+			 * lies completely in front of are cleared, so boxes contained in
+			 * this box do not need to be tested against these planes again.
+			 * @return False if the box lies completely outside of the frustum.
+			 */
+			bool isVisible(const math::BoundingBox &box,
+			               unsigned int &planemask) const;
+			/**
+			 * Checks whether a world space bounding box is not completely in
+			 * front of the near plane, i.e. whether it would be clipped when
+			 * drawn or contains the camera.
+			 */
+			bool intersectsNearPlane(const math::BoundingBox &box) const;
+			/**
+			 * Checks whether a sphere is at least partially visible.
+			 * @param center Center of the sphere in world space.
+			 * @param radius Radius of the sphere.
+			 */
+			bool isSphereVisible(const math::Vec3f &center, float radius) const;
+			/**
+			 * Checks whether a cone is at least partially visible.
+			 * @param apex Apex of the cone in world space.
+			 * @param direction Normalized direction of the cone axis.
+			 * @param height Length of the cone along its axis.
+			 * @param baseradius Radius of the base of the cone.
+			 */
+			bool isConeVisible(const math::Vec3f &apex,
+			                   const math::Vec3f &direction,
+			                   float height,
+			                   float baseradius) const;
+			/**
+			 * Culls a list of instances of the same bounding box. The
+			 * instances are tested four at a time using SSE if available.
+			 * @param box Bounding box in object space.
+			 * @param transmat Transformation matrices of the instances.
+			 * @param count Number of instances.
+			 * @param visible Array with at least count entries which receives
+			 * the transformation matrices of all visible instances. May be
+			 * equal to transmat to compact the list in place.
+			 * @return Number of visible instances.
+			 */
+			unsigned int cullInstances(const math::BoundingBox &box,
+			                           const math::Mat4f *transmat,
+			                           unsigned int count,
+			                           math::Mat4f *visible) const;
+
+			/**
+			 * Computes an axis-aligned bounding box containing the given box
+			 * after it has been transformed.
+			 */
+			static math::BoundingBox transformBox(const math::BoundingBox &box,
+			                                      const math::Mat4f &transmat);
+			/**
+			 * Returns the smallest box containing both boxes.
+			 */
+			static math::BoundingBox mergeBoxes(const math::BoundingBox &a,
+			                                    const math::BoundingBox &b);
+
+			/**
+			 * Plane mask containing all six planes.
+			 */
+			static const unsigned int ALL_PLANES = 0x3f;
+		private:
+			bool enabled;
+			/**
+			 * Planes (a, b, c, d) with a * x + b * y + c * z + d >= 0 for all
+			 * points inside the frustum. The planes are normalized so that
+			 * the left side is the distance to the plane.
+			 */
+			float planes[6][4];
+	};
+}
+}
+
+#endif
@@ -25,10 +25,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "Shader.hpp"
 #include "Texture.hpp"
 
+#include <tbb/spin_mutex.h>
+
 namespace cr
 {
+namespace core
+{
+	class MemoryPool;
+}
 namespace render
 {
+	struct CustomUniform;
+
 	/**
 	 * Material definition which contains a shader text, flags, uniform values
 	 * and textures.
@@ -140,6 +148,11 @@ namespace render
 				 * Name of the uniform.
 				 */
 				std::string name;
+				/**
+				 * Handle of the name as returned by
+				 * res::NameRegistry::getUniform().
+				 */
+				unsigned int handle;
 				/**
 				 * Number of float components.
 				 */
@@ -156,6 +169,21 @@ namespace render
 			{
 				return uniforms;
 			}
+			/**
+			 * Returns a read-only copy of the uniforms of the material for the
+			 * frame with the given ID. The copy is only created the first time
+			 * this is called for a frame, all batches of the frame then share
+			 * it which allows the video driver to skip uploading the uniforms
+			 * again for consecutive batches.
+			 * @param memory Memory pool of the frame.
+			 * @param frameid ID of the frame as returned by
+			 * FrameData::getFrameId().
+			 * @param count Receives the number of uniforms.
+			 * @return Uniform array, allocated from the memory pool.
+			 */
+			CustomUniform *getUniformSnapshot(core::MemoryPool *memory,
+			                                  unsigned int frameid,
+			                                  unsigned int &count);
 
 			virtual bool load();
 
@@ -192,6 +220,10 @@ namespace render
 
 			std::vector<TextureInfo> textures;
 			std::vector<UniformInfo> uniforms;
+			tbb::spin_mutex uniformmutex;
+			unsigned int snapshotframe;
+			CustomUniform *snapshot;
+			unsigned int snapshotcount;
 			TextureList *uploadeddata;
 	};
 }
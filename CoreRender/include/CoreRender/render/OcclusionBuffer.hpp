@@ -0,0 +1,165 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _CORERENDER_RENDER_OCCLUSIONBUFFER_HPP_INCLUDED_
+#define _CORERENDER_RENDER_OCCLUSIONBUFFER_HPP_INCLUDED_
+
+#include <GameMath.hpp>
+#include <vector>
+
+namespace cr
+{
+namespace render
+{
+	/**
+	 * Low resolution depth buffer which is filled on the CPU with a few
+	 * large occluders (e.g. the walls of buildings) and is then used to cull
+	 * objects hidden behind them before they are added to a render queue.
+	 *
+	 * The occluders are rasterized four pixels at a time using SSE if
+	 * available. Afterwards buildHierarchy() creates a hierarchical
+	 * depth buffer containing the maximum depth of every tile, so that
+	 * bounding boxes can be tested with a few lookups regardless of their
+	 * size on the screen.
+	 *
+	 * Usage:
+	 * @code
+	 * buffer.clear(projmat * viewmat);
+	 * buffer.drawOccluder(...);
+	 * buffer.buildHierarchy();
+	 * if (buffer.isVisible(box))
+	 *     ...
+	 * @endcode
+	 */
+	class OcclusionBuffer
+	{
+		public:
+			/**
+			 * Constructor.
+			 * @param width Width of the depth buffer. Rounded up to a
+			 * multiple of four.
+			 * @param height Height of the depth buffer.
+			 */
+			OcclusionBuffer(unsigned int width = 256, unsigned int height = 128);
+			~OcclusionBuffer();
+
+			/**
+			 * Clears the depth buffer and removes all occluders.
+			 * @param viewproj Projection matrix multiplied with the view
+			 * matrix of the camera.
+			 */
+			void clear(const math::Mat4f &viewproj);
+			/**
+			 * Rasterizes an occluder mesh into the depth buffer. Triangles
+			 * intersecting the near plane are skipped.
+			 * @param positions Vertex positions, three floats per vertex.
+			 * @param vertexcount Number of vertices.
+			 * @param indices Three indices per triangle.
+			 * @param indexcount Number of indices.
+			 * @param transmat Transformation from object to world space.
+			 */
+			void drawOccluder(const float *positions,
+			                  unsigned int vertexcount,
+			                  const unsigned int *indices,
+			                  unsigned int indexcount,
+			                  const math::Mat4f &transmat);
+			/**
+			 * Creates the depth hierarchy. Has to be called after all
+			 * occluders have been drawn and before isVisible().
+			 */
+			void buildHierarchy();
+
+			/**
+			 * Checks whether a world space bounding box might be visible.
+			 * @return False if the box is completely hidden behind the
+			 * occluders.
+			 */
+			bool isVisible(const math::BoundingBox &box) const;
+			/**
+			 * Removes the hidden instances from a list of instances of the
+			 * same bounding box.
+			 * @param box Bounding box in object space.
+			 * @param transmat Transformation matrices of the instances.
+			 * @param count Number of instances.
+			 * @param visible Array with at least count entries which receives
+			 * the transformation matrices of all visible instances. May be
+			 * equal to transmat to compact the list in place.
+			 * @return Number of visible instances.
+			 */
+			unsigned int cullInstances(const math::BoundingBox &box,
+			                           const math::Mat4f *transmat,
+			                           unsigned int count,
+			                           math::Mat4f *visible) const;
+
+			/**
+			 * Returns true if at least one occluder triangle was drawn since
+			 * the last call to clear().
+			 */
+			bool hasOccluders() const
+			{
+				return occludertriangles != 0;
+			}
+			unsigned int getOccluderTriangleCount() const
+			{
+				return occludertriangles;
+			}
+
+			unsigned int getWidth() const
+			{
+				return width;
+			}
+			unsigned int getHeight() const
+			{
+				return height;
+			}
+			/**
+			 * Returns the depth buffer (normalized device coordinates, 1.0
+			 * is the far plane).
+			 */
+			const float *getDepth() const
+			{
+				return &levels[0].depth[0];
+			}
+		private:
+			void drawTriangle(const float *v0, const float *v1, const float *v2);
+
+			struct Level
+			{
+				unsigned int width;
+				unsigned int height;
+				std::vector<float> depth;
+			};
+
+			unsigned int width;
+			unsigned int height;
+			std::vector<Level> levels;
+			math::Mat4f viewproj;
+			unsigned int occludertriangles;
+			/**
+			 * Screen space vertices of the current occluder, reused for all
+			 * occluders to prevent allocations.
+			 */
+			std::vector<float> screenvertices;
+	};
+}
+}
+
+#endif
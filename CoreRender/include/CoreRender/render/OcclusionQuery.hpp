@@ -0,0 +1,188 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _CORERENDER_RENDER_OCCLUSIONQUERY_HPP_INCLUDED_
+#define _CORERENDER_RENDER_OCCLUSIONQUERY_HPP_INCLUDED_
+
+#include "RenderObject.hpp"
+
+#include <GameMath.hpp>
+#include <tbb/spin_mutex.h>
+#include <vector>
+
+namespace cr
+{
+namespace core
+{
+	class MemoryPool;
+}
+namespace render
+{
+	/**
+	 * Set of hardware occlusion queries for the objects seen by a single
+	 * camera. The bounding boxes of the objects are drawn after the geometry
+	 * of the camera, and the results are read back by the render thread as
+	 * soon as they are available, which usually is one or two frames later.
+	 * The scene then uses the last available result to decide whether an
+	 * object is drawn, so that the CPU never has to wait for the GPU.
+	 *
+	 * Objects without a recent result are always treated as visible, so if
+	 * the video driver does not support occlusion queries nothing is culled.
+	 *
+	 * Usage (main thread):
+	 * @code
+	 * query->update();
+	 * if (query->isVisible(object))
+	 *     ...draw object...
+	 * if (query->needsQuery(object))
+	 *     query->addRequest(object, worldbox);
+	 * ...
+	 * requests = query->takeRequests(memory, count);
+	 * @endcode
+	 */
+	class OcclusionQuery : public RenderObject
+	{
+		public:
+			/**
+			 * Query for the world space bounding box of a single object.
+			 */
+			struct Request
+			{
+				unsigned int object;
+				/**
+				 * Value of getFrame() when the request was created.
+				 */
+				unsigned int frame;
+				float min[3];
+				float max[3];
+			};
+
+			OcclusionQuery(UploadManager &uploadmgr);
+			virtual ~OcclusionQuery();
+
+			/**
+			 * Applies the results which the render thread has read back since
+			 * the last call and starts a new frame. Has to be called once
+			 * every frame before any call to isVisible().
+			 */
+			void update();
+			/**
+			 * Returns whether the object was visible in its last query.
+			 * Objects without a result or with a result which is older than
+			 * MAX_RESULT_AGE frames are visible.
+			 */
+			bool isVisible(unsigned int object) const
+			{
+				if (object >= results.size())
+					return true;
+				const Result &result = results[object];
+				if (result.visible)
+					return true;
+				return frame - result.frame > MAX_RESULT_AGE;
+			}
+			/**
+			 * Returns whether a new query has to be issued for the object.
+			 * Hidden objects are queried every frame so that they appear as
+			 * soon as possible, while visible objects are only queried every
+			 * VISIBLE_QUERY_INTERVAL frames.
+			 */
+			bool needsQuery(unsigned int object) const
+			{
+				if (!isVisible(object))
+					return true;
+				return (object + frame) % VISIBLE_QUERY_INTERVAL == 0;
+			}
+			/**
+			 * Requests a query for an object. Must not be called by multiple
+			 * threads at once.
+			 * @param object Object ID which is passed to isVisible().
+			 * @param box World space bounding box of the object.
+			 */
+			void addRequest(unsigned int object, const math::BoundingBox &box);
+			/**
+			 * Moves all requests of this frame into frame memory so that they
+			 * can be passed to the render thread.
+			 * @param memory Memory pool of the frame.
+			 * @param count Is set to the number of requests.
+			 * @return Requests or 0 if there are no requests.
+			 */
+			Request *takeRequests(core::MemoryPool *memory, unsigned int &count);
+			/**
+			 * Returns the number of the current frame, incremented by
+			 * update().
+			 */
+			unsigned int getFrame() const
+			{
+				return frame;
+			}
+
+			/**
+			 * Stores the result of a query. Called by the video driver on the
+			 * render thread.
+			 * @param request Request which was queried.
+			 * @param visible True if any samples of the box passed the depth
+			 * test.
+			 */
+			void addResult(const Request &request, bool visible);
+
+			virtual void upload(void *data)
+			{
+			}
+
+			typedef core::SharedPointer<OcclusionQuery> Ptr;
+
+			/**
+			 * Number of frames after which a result is not used any more.
+			 * Hidden objects are queried every frame, so their results only
+			 * become this old if the GPU is far behind or if the object was
+			 * outside of the view frustum.
+			 */
+			static const unsigned int MAX_RESULT_AGE = 3;
+			static const unsigned int VISIBLE_QUERY_INTERVAL = 4;
+		protected:
+			virtual void *getUploadData()
+			{
+				return 0;
+			}
+		private:
+			struct Result
+			{
+				unsigned int frame;
+				bool visible;
+			};
+			struct PendingResult
+			{
+				unsigned int object;
+				unsigned int frame;
+				bool visible;
+			};
+
+			unsigned int frame;
+			std::vector<Result> results;
+			std::vector<Request> requests;
+
+			tbb::spin_mutex pendingmutex;
+			std::vector<PendingResult> pending;
+	};
+}
+}
+
+#endif
@@ -66,6 +66,9 @@ namespace render
 					TextureRG,
 					VertexHalfFloat,
 					PointSprite,
+					VertexArrayObject,
+					MultiDraw,
+					DrawBaseVertex,
 					Count
 				};
 			};
@@ -81,6 +81,16 @@ namespace render
 			 * value returned by isUploading() to true.
 			 */
 			void registerUpload();
+
+			/**
+			 * Returns a small number identifying the object. This is used to
+			 * sort batches by state. The numbers are assigned sequentially
+			 * and wrap around, so they are not guaranteed to be unique.
+			 */
+			unsigned int getSortId()
+			{
+				return sortid;
+			}
 		protected:
 			UploadManager &getUploadManager()
 			{
@@ -99,6 +109,8 @@ namespace render
 
 			tbb::mutex uploadmutex;
 			bool uploading;
+
+			unsigned int sortid;
 	};
 }
 }
@@ -82,6 +82,16 @@ namespace render
 			 */
 			bool isUploading();
 
+			/**
+			 * Returns a small number identifying the resource. This is used to
+			 * sort batches by state. The numbers are assigned sequentially
+			 * and wrap around, so they are not guaranteed to be unique.
+			 */
+			unsigned int getSortId()
+			{
+				return sortid;
+			}
+
 			typedef core::SharedPointer<RenderResource> Ptr;
 		protected:
 			UploadManager &getUploadManager()
@@ -109,6 +119,8 @@ namespace render
 
 			tbb::mutex uploadmutex;
 			bool uploading;
+
+			unsigned int sortid;
 	};
 }
 }
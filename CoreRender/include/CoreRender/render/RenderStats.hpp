@@ -23,6 +23,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define _CORERENDER_RENDER_RENDERSTATS_HPP_INCLUDED_
 
 #include "../core/Time.hpp"
+#include "../core/MemoryPool.hpp"
 
 namespace cr
 {
@@ -39,7 +40,11 @@ namespace render
 			 * Constructor.
 			 */
 			RenderStats()
-				: polygons(0), batches(0), fps(0.0f), averagefps(0),
+				: polygons(0), batches(0), drawcalls(0), uniformcalls(0),
+				texturebinds(0),
+				statechanges(0),
+				unsortedstatechanges(0), mergedbatches(0), occlusionqueries(0),
+				occlusionculled(0), fps(0.0f), averagefps(0),
 				frametime(core::Duration::Seconds(0)),
 				averageframetime(core::Duration::Seconds(0)),
 				uploadtime(core::Duration::Seconds(0)),
@@ -57,6 +62,14 @@ namespace render
 			{
 				polygons = other.polygons;
 				batches = other.batches;
+				drawcalls = other.drawcalls;
+				uniformcalls = other.uniformcalls;
+				texturebinds = other.texturebinds;
+				statechanges = other.statechanges;
+				unsortedstatechanges = other.unsortedstatechanges;
+				mergedbatches = other.mergedbatches;
+				occlusionqueries = other.occlusionqueries;
+				occlusionculled = other.occlusionculled;
 				fps = other.fps;
 				averagefps = other.averagefps;
 				frametime = other.frametime;
@@ -67,6 +80,7 @@ namespace render
 				averagecomposetime = other.averagecomposetime;
 				uploadtime = other.uploadtime;
 				averageuploadtime = other.averageuploadtime;
+				framememory = other.framememory;
 			}
 			/**
 			 * Destructor.
@@ -90,6 +104,87 @@ namespace render
 			{
 				return batches;
 			}
+			/**
+			 * Returns the number of draw calls issued to the GPU. Several
+			 * batches can be drawn with a single draw call if they are
+			 * instanced or share their state and vertex buffer.
+			 */
+			unsigned int getDrawCallCount() const
+			{
+				return drawcalls;
+			}
+			/**
+			 * Returns the average number of batches which were drawn with a
+			 * single draw call.
+			 */
+			float getBatchesPerDrawCall() const
+			{
+				if (drawcalls == 0)
+					return 0.0f;
+				return (float)batches / drawcalls;
+			}
+			/**
+			 * Returns the number of uniform values which were sent to the GPU.
+			 * Uniforms which still have the same value in the shader are not
+			 * sent again and are not counted.
+			 */
+			unsigned int getUniformCallCount() const
+			{
+				return uniformcalls;
+			}
+			/**
+			 * Returns the number of textures which were bound to texture
+			 * units. Textures which were still bound from the last batch are
+			 * not bound again and are not counted.
+			 */
+			unsigned int getTextureBindCount() const
+			{
+				return texturebinds;
+			}
+			/**
+			 * Returns the number of shader, material and mesh changes between
+			 * consecutive batches in the render queues after the batches have
+			 * been sorted.
+			 */
+			unsigned int getStateChangeCount() const
+			{
+				return statechanges;
+			}
+			/**
+			 * Returns the number of shader, material and mesh changes the
+			 * render queues would have caused without sorting. Together with
+			 * getStateChangeCount() this shows how effective the sorting is.
+			 */
+			unsigned int getUnsortedStateChangeCount() const
+			{
+				return unsortedstatechanges;
+			}
+			/**
+			 * Returns the number of batches which were merged into instanced
+			 * batches because they only differed in their transformation
+			 * matrix.
+			 */
+			unsigned int getMergedBatchCount() const
+			{
+				return mergedbatches;
+			}
+			/**
+			 * Returns the number of hardware occlusion queries which were
+			 * issued.
+			 */
+			unsigned int getOcclusionQueryCount() const
+			{
+				return occlusionqueries;
+			}
+			/**
+			 * Returns the number of objects which were not added to a render
+			 * queue because the last hardware occlusion query reported them
+			 * as hidden.
+			 */
+			unsigned int getOcclusionCulledCount() const
+			{
+				return occlusionculled;
+			}
 			/**
 			 * Returns the number of frames rendered per second. Note that this
 			 * is only measured based on the time between the last and this
@@ -172,6 +267,15 @@ namespace render
 			{
 				return averagecomposetime;
 			}
+			/**
+			 * Returns the usage statistics of the memory pool of the frame,
+			 * which contains all data created between
+			 * GraphicsEngine::beginFrame() and GraphicsEngine::render().
+			 */
+			const core::MemoryPoolStats &getFrameMemoryStats() const
+			{
+				return framememory;
+			}
 
 			/**
 			 * Resets all statistics and sets them to 0.
@@ -180,6 +284,10 @@ namespace render
 			{
 				polygons = 0;
 				batches = 0;
+				drawcalls = 0;
+				uniformcalls = 0;
+				texturebinds = 0;
+				occlusionqueries = 0;
 				fps = 0.0f;
 				averagefps = 0.0f;
 			}
@@ -191,6 +299,30 @@ namespace render
 			{
 				this->batches += batches;
 			}
+			/**
+			 * Signals the class that a certain number of draw calls has been
+			 * issued. This is called by VideoDriver::draw().
+			 */
+			void increaseDrawCallCount(unsigned int drawcalls)
+			{
+				this->drawcalls += drawcalls;
+			}
+			/**
+			 * Signals the class that a certain number of uniform values has
+			 * been sent to the GPU. This is called by VideoDriver::draw().
+			 */
+			void increaseUniformCallCount(unsigned int uniformcalls)
+			{
+				this->uniformcalls += uniformcalls;
+			}
+			/**
+			 * Signals the class that a certain number of textures has been
+			 * bound. This is called by VideoDriver::draw().
+			 */
+			void increaseTextureBindCount(unsigned int texturebinds)
+			{
+				this->texturebinds += texturebinds;
+			}
 			/**
 			 * Signals the class that a certain number of polygons has been
 			 * rendered. This is called by VideoDriver::draw().
@@ -199,11 +331,28 @@ namespace render
 			{
 				this->polygons += polygons;
 			}
+			/**
+			 * Signals the class that a certain number of occlusion queries
+			 * has been issued. This is called by
+			 * VideoDriver::drawOcclusionQueries().
+			 */
+			void increaseOcclusionQueryCount(unsigned int queries)
+			{
+				occlusionqueries += queries;
+			}
 
 			RenderStats &operator=(const RenderStats &other)
 			{
 				polygons = other.polygons;
 				batches = other.batches;
+				drawcalls = other.drawcalls;
+				uniformcalls = other.uniformcalls;
+				texturebinds = other.texturebinds;
+				statechanges = other.statechanges;
+				unsortedstatechanges = other.unsortedstatechanges;
+				mergedbatches = other.mergedbatches;
+				occlusionqueries = other.occlusionqueries;
+				occlusionculled = other.occlusionculled;
 				fps = other.fps;
 				averagefps = other.averagefps;
 				frametime = other.frametime;
@@ -214,6 +363,7 @@ namespace render
 				averagecomposetime = other.averagecomposetime;
 				uploadtime = other.uploadtime;
 				averageuploadtime = other.averageuploadtime;
+				framememory = other.framememory;
 				return *this;
 			}
 		private:
@@ -221,6 +371,14 @@ namespace render
 
 			unsigned int polygons;
 			unsigned int batches;
+			unsigned int drawcalls;
+			unsigned int uniformcalls;
+			unsigned int texturebinds;
+			unsigned int statechanges;
+			unsigned int unsortedstatechanges;
+			unsigned int mergedbatches;
+			unsigned int occlusionqueries;
+			unsigned int occlusionculled;
 			float fps;
 			float averagefps;
 			core::Duration frametime;
@@ -231,6 +389,7 @@ namespace render
 			core::Duration averagerendertime;
 			core::Duration composetime;
 			core::Duration averagecomposetime;
+			core::MemoryPoolStats framememory;
 	};
 }
 }
@@ -216,6 +216,7 @@ namespace render
 			struct Uniform
 			{
 				std::string name;
+				unsigned int handle;
 				unsigned int size;
 				float defvalue[16];
 			};
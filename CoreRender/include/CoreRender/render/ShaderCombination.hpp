@@ -26,6 +26,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "BlendMode.hpp"
 #include "DepthTest.hpp"
 
+#include <tbb/atomic.h>
 #include <vector>
 #include <string>
 
@@ -54,6 +55,28 @@ namespace render
 		int shadowsplitdist;
 		int shadowmap;
 	};
+	/**
+	 * Whether a shader combination uses the worldNormalMat uniform.
+	 */
+	struct NormalMatrixUsage
+	{
+		enum List
+		{
+			/**
+			 * The shader has not been compiled yet, so the normal matrix has
+			 * to be provided in case the shader uses it.
+			 */
+			Unknown,
+			/**
+			 * The linked program uses the uniform.
+			 */
+			Used,
+			/**
+			 * The uniform is not declared or was optimized away.
+			 */
+			Unused
+		};
+	};
 	struct ShaderCombination : public RenderObject
 	{
 		ShaderCombination(UploadManager &uploadmgr)
@@ -64,6 +87,11 @@ namespace render
 			shaderobjects[1] = 0;
 			shaderobjects[2] = 0;
 			shaderobjects[3] = 0;
+			attribset = 0;
+			normalmatrix = NormalMatrixUsage::Unknown;
+			samplerunitsset = false;
+			camerageneration = 0;
+			lightgeneration = 0;
 		}
 		virtual ~ShaderCombination();
 
@@ -89,19 +117,71 @@ namespace render
 		ShaderCombinationData uploadeddata;
 
 		UniformLocations uniforms;
+		/**
+		 * Usage of the worldNormalMat uniform (NormalMatrixUsage::List).
+		 * Set by the video driver when the program has been linked and read
+		 * by FrameData::optimize() on other threads.
+		 */
+		tbb::atomic<unsigned int> normalmatrix;
 		std::vector<int> customuniforms;
+		/**
+		 * Index into customuniforms for every uniform handle (see
+		 * res::NameRegistry::getUniform()), -1 if the shader does not declare
+		 * the uniform.
+		 */
+		std::vector<int> customuniformindices;
 		std::vector<int> attriblocations;
 		std::vector<int> samplerlocations;
+		/**
+		 * True if the texture units of the samplers have already been set in
+		 * the program. Every sampler i always uses texture unit i.
+		 */
+		bool samplerunitsset;
 		/**
 		 * Location of the transMat attribute for instancing.
 		 */
 		int transmatattrib;
+		/**
+		 * Locations of the quadRect attribute and of the per-instance light
+		 * attributes used by VideoDriver::drawQuad() and
+		 * VideoDriver::drawQuads().
+		 */
+		int quadrectattrib;
+		int lightposattrib;
+		int lightcolorattrib;
+		int lightdirattrib;
+		/**
+		 * ID of the attrib names and locations of the program. All programs
+		 * with the same attrib set can share vertex array objects.
+		 */
+		unsigned int attribset;
 
 		Shader *shader;
 
 		unsigned int programobject;
 		unsigned int shaderobjects[4];
 
+		/**
+		 * Generation of the camera uniforms which were last uploaded to the
+		 * program, used by the video driver to skip redundant uploads.
+		 */
+		unsigned int camerageneration;
+		/**
+		 * Generation of the light uniforms which were last uploaded to the
+		 * program.
+		 */
+		unsigned int lightgeneration;
+		/**
+		 * Shadow copy of the last values of the custom uniforms (16 floats
+		 * per uniform) in the program.
+		 */
+		std::vector<float> customuniformcache;
+		/**
+		 * Size of the cached custom uniform values, 0 if the uniform has not
+		 * been uploaded yet.
+		 */
+		std::vector<unsigned int> customuniformcachesize;
+
 		typedef core::SharedPointer<ShaderCombination> Ptr;
 	};
 }
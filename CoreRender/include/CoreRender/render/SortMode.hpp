@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _CORERENDER_RENDER_SORTMODE_HPP_INCLUDED_
+#define _CORERENDER_RENDER_SORTMODE_HPP_INCLUDED_
+
+namespace cr
+{
+namespace render
+{
+	/**
+	 * Defines the order in which the batches of a render queue are drawn.
+	 * Batches using a shader with BlendMode::Blend or BlendMode::AddBlended
+	 * are always drawn after all other batches in back-to-front order unless
+	 * None is used. Blended batches at the same depth are drawn in the order
+	 * in which they were submitted.
+	 */
+	struct SortMode
+	{
+		enum List
+		{
+			/**
+			 * Sorts the batches to minimize state changes (shader, material,
+			 * mesh), batches with the same state are sorted front-to-back.
+			 * This is the default value.
+			 */
+			State,
+			/**
+			 * Sorts the batches front-to-back to reduce overdraw.
+			 */
+			FrontToBack,
+			/**
+			 * Sorts the batches back-to-front.
+			 */
+			BackToFront,
+			/**
+			 * Draws the batches in the order in which they were submitted.
+			 * If the queue was filled by several threads, only the batches
+			 * of each thread keep their order, see RenderQueue::mergeBatches().
+			 */
+			None
+		};
+	};
+}
+}
+
+#endif
@@ -79,11 +79,38 @@ namespace res
 					return "";
 				return contextnames[name];
 			}
+
+			/**
+			 * Returns the handle of a custom shader uniform. Batches and
+			 * shaders refer to custom uniforms via these handles so that no
+			 * string comparisons are necessary while rendering.
+			 */
+			unsigned int getUniform(const std::string &name)
+			{
+				tbb::mutex::scoped_lock lock(uniformmutex);
+				// TODO: This is slow, maybe use a hash map additionally
+				for (unsigned int i = 0; i < uniformnames.size(); i++)
+				{
+					if (uniformnames[i] == name)
+						return i;
+				}
+				uniformnames.push_back(name);
+				return uniformnames.size() - 1;
+			}
+			std::string getUniform(unsigned int name)
+			{
+				tbb::mutex::scoped_lock lock(uniformmutex);
+				if (name >= uniformnames.size())
+					return "";
+				return uniformnames[name];
+			}
 		private:
 			tbb::mutex attribmutex;
 			std::vector<std::string> attribnames;
 			tbb::mutex contextmutex;
 			std::vector<std::string> contextnames;
+			tbb::mutex uniformmutex;
+			std::vector<std::string> uniformnames;
 	};
 }
 }
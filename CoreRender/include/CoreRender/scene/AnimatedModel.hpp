@@ -80,6 +80,16 @@ namespace scene
 			                 NodeAnimationInfo *nodes,
 			                 float weightsum);
 			void applyAnimation(std::vector<Model::Node> &nodes);
+			/**
+			 * Computes the bounding box of an animated batch in model space.
+			 * If the batch is influenced by joints, the box also contains the
+			 * bounding box transformed by every joint matrix as the batch
+			 * might be drawn using skinning.
+			 * @return False if the batch has no valid geometry.
+			 */
+			bool getBatchBox(unsigned int batchindex,
+			                 const std::vector<Model::Node> &animatednodes,
+			                 math::BoundingBox &box);
 
 			Model::Ptr model;
 			std::vector<AnimationStage> animstages;
@@ -25,6 +25,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "../core/ReferenceCounted.hpp"
 #include "../render/Pipeline.hpp"
 #include "../render/RenderTarget.hpp"
+#include "../render/OcclusionQuery.hpp"
 
 #include <GameMath.hpp>
 
@@ -56,6 +57,26 @@ namespace scene
 				return target;
 			}
 
+			/**
+			 * Enables hardware occlusion queries for the models registered
+			 * with the scene. The bounding boxes of the models are tested
+			 * against the depth buffer after the first DrawGeometry command
+			 * of the pipeline, and models which were hidden in the last
+			 * available result are skipped. As results are only used once
+			 * they are available, hidden models may appear a frame late.
+			 * @param query Query object created with
+			 * GraphicsEngine::createOcclusionQuery(), or 0 to disable
+			 * occlusion queries.
+			 */
+			void setOcclusionQuery(render::OcclusionQuery::Ptr query)
+			{
+				occlusionquery = query;
+			}
+			render::OcclusionQuery::Ptr getOcclusionQuery()
+			{
+				return occlusionquery;
+			}
+
 			void setProjMat(math::Mat4f projmat)
 			{
 				this->projmat = projmat;
@@ -92,6 +113,7 @@ namespace scene
 		private:
 			render::Pipeline::Ptr pipeline;
 			render::RenderTarget::Ptr target;
+			render::OcclusionQuery::Ptr occlusionquery;
 
 			unsigned int viewport[4];
 			math::Mat4f projmat;
@@ -32,7 +32,11 @@ namespace scene
 {
 	struct GeometryFile
 	{
-		static const unsigned int version = 0;
+		/**
+		 * Version 1 adds the bounding box of every batch, which is stored
+		 * after its GeometryInfo.
+		 */
+		static const unsigned int version = 1;
 		static const unsigned int tag = (int)'C' + 256 * 'R' + 65536 * 'G';
 		static const unsigned int maxtexcoords = 8;
 		static const unsigned int maxcolors = 4;
@@ -36,6 +36,7 @@ namespace render
 	struct LightUniforms;
 	class SceneFrameData;
 	struct RenderQueue;
+	class Frustum;
 }
 namespace scene
 {
@@ -103,8 +104,20 @@ namespace scene
 			                               Camera::Ptr camera,
 			                               math::Mat4f *shadowmat,
 			                               render::LightUniforms *uniforms);
-			virtual void getLightQuad(Camera::Ptr camera,
+			/**
+			 * Computes the screen space rectangle affected by the light.
+			 * @param camera Camera the light is rendered for.
+			 * @param quad Receives the rectangle as (left, bottom, right, top)
+			 * in normalized device coordinates, clamped to the screen.
+			 * @return False if the rectangle is empty.
+			 */
+			virtual bool getLightQuad(Camera::Ptr camera,
 			                          float *quad) = 0;
+			/**
+			 * Checks whether the volume affected by the light intersects a
+			 * view frustum.
+			 */
+			virtual bool isVisible(const render::Frustum &frustum) = 0;
 
 			virtual void getLightInfo(render::LightUniforms *uniforms);
 
@@ -118,6 +131,14 @@ namespace scene
 			{
 				this->shadowmapcount = shadowmapcount;
 			}
+
+			/**
+			 * Projects a world space bounding box onto the screen, used to
+			 * implement getLightQuad().
+			 */
+			static bool getScreenRect(Camera::Ptr camera,
+			                          const math::BoundingBox &box,
+			                          float *quad);
 		private:
 			core::Color color;
 
@@ -52,8 +52,17 @@ namespace scene
 			      const std::string& name);
 			virtual ~Model();
 
+			/**
+			 * Adds the batches of the model to a render queue.
+			 * @param queue Render queue the batches are added to.
+			 * @param transmat Transformation matrix of the model.
+			 * @param testocclusion If false, the batches are not tested
+			 * against the occlusion buffer of the queue, for example because
+			 * the caller already tested the bounding box of the whole model.
+			 */
 			void render(render::RenderQueue &queue,
-			            math::Mat4f transmat);
+			            math::Mat4f transmat,
+			            bool testocclusion = true);
 			void render(render::RenderQueue &queue,
 			            unsigned int instancecount,
 			            math::Mat4f *transmat);
@@ -81,6 +90,11 @@ namespace scene
 				 * Joints influencing this batch.
 				 */
 				std::vector<Joint> joints;
+				/**
+				 * Bounding box of the vertices of the batch before the
+				 * transformation of the node is applied.
+				 */
+				math::BoundingBox boundingbox;
 			};
 
 			struct Batch
@@ -143,8 +157,55 @@ namespace scene
 				return changecounter;
 			}
 
+			/**
+			 * Checks whether a batch is visible in a render queue.
+			 * @param queue Render queue the batch is about to be added to.
+			 * @param batchindex Index of the batch.
+			 * @param transmat Transformation matrix of the batch, including
+			 * the transformation of its node.
+			 * @param testocclusion If true, the batch is also tested against
+			 * the occlusion buffer of the queue.
+			 * @return False if the batch lies completely outside of the view
+			 * frustum of the queue or is hidden behind occluders.
+			 */
+			bool isBatchVisible(render::RenderQueue &queue,
+			                    unsigned int batchindex,
+			                    const math::Mat4f &transmat,
+			                    bool testocclusion = true);
+			/**
+			 * Checks whether a bounding box is visible in a render queue.
+			 * @param queue Render queue the batch is about to be added to.
+			 * @param box Bounding box in object space.
+			 * @param transmat Transformation matrix of the box.
+			 * @param testocclusion If true, the box is also tested against
+			 * the occlusion buffer of the queue.
+			 * @return False if the box lies completely outside of the view
+			 * frustum of the queue or is hidden behind occluders.
+			 */
+			static bool isBoxVisible(render::RenderQueue &queue,
+			                         const math::BoundingBox &box,
+			                         const math::Mat4f &transmat,
+			                         bool testocclusion = true);
+			/**
+			 * Removes the instances which are outside of the view frustum
+			 * of a render queue or hidden behind its occluders.
+			 * @param queue Render queue the instances are added to.
+			 * @param box Bounding box of the batch in object space.
+			 * @param instancecount Number of instances.
+			 * @param transmat Transformation matrices of the instances.
+			 * @param visible Array with at least instancecount entries which
+			 * receives the matrices of the visible instances.
+			 * @return Number of visible instances.
+			 */
+			static unsigned int cullInstances(render::RenderQueue &queue,
+			                                  const math::BoundingBox &box,
+			                                  unsigned int instancecount,
+			                                  const math::Mat4f *transmat,
+			                                  math::Mat4f *visible);
+
 			render::Batch *prepareBatch(render::RenderQueue &queue,
 			                            unsigned int batchindex,
+			                            const math::Mat4f &transmat,
 			                            bool instancing,
 			                            bool skinning);
 
@@ -53,8 +53,9 @@ namespace scene
 				return radius;
 			}
 
-			virtual void getLightQuad(Camera::Ptr camera,
+			virtual bool getLightQuad(Camera::Ptr camera,
 			                          float *quad);
+			virtual bool isVisible(const render::Frustum &frustum);
 
 			virtual void getLightInfo(render::LightUniforms *uniforms);
 
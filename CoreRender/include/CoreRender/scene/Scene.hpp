@@ -24,6 +24,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "Camera.hpp"
 #include "Light.hpp"
+#include "Model.hpp"
+#include "SpatialIndex.hpp"
 
 namespace cr
 {
@@ -33,7 +35,9 @@ namespace render
 	class SceneFrameData;
 	class FrameData;
 	struct RenderQueue;
+	struct RenderCommand;
 	struct TextureBinding;
+	class OcclusionBuffer;
 }
 namespace scene
 {
@@ -50,9 +54,89 @@ namespace scene
 			void addLight(Light::Ptr light);
 			void removeLight(Light::Ptr light);
 
+			/**
+			 * Registers a model instance with the scene. The instance is
+			 * added to all render queues it is visible in during
+			 * beginFrame(), so the application does not need to call
+			 * Model::render() itself.
+			 * @param model Model to be rendered.
+			 * @param transmat Transformation of the instance.
+			 * @param bounds Bounding box of the model before the
+			 * transformation is applied.
+			 * @return Handle of the instance.
+			 */
+			unsigned int addModel(Model::Ptr model,
+			                      const math::Mat4f &transmat,
+			                      const math::BoundingBox &bounds);
+			/**
+			 * Moves a model instance. Small movements are cheap as the
+			 * spatial index is only refitted.
+			 * @param handle Handle returned by addModel().
+			 * @param transmat New transformation of the instance.
+			 */
+			void setModelTransformation(unsigned int handle,
+			                            const math::Mat4f &transmat);
+			/**
+			 * Removes a model instance from the scene.
+			 * @param handle Handle returned by addModel().
+			 */
+			void removeModel(unsigned int handle);
+
+			/**
+			 * Registers an occluder mesh. Occluders are rasterized into a
+			 * low resolution depth buffer for every camera, and registered
+			 * models and model batches hidden behind them are not added to
+			 * the render queues of the camera. Occluders should be simple
+			 * meshes which lie completely inside the geometry they represent,
+			 * e.g. the walls of buildings.
+			 * @param positions Vertex positions, three floats per vertex. The
+			 * data is copied.
+			 * @param vertexcount Number of vertices.
+			 * @param indices Three indices per triangle.
+			 * @param indexcount Number of indices.
+			 * @param transmat Transformation of the occluder.
+			 * @return Handle of the occluder.
+			 */
+			unsigned int addOccluder(const float *positions,
+			                         unsigned int vertexcount,
+			                         const unsigned int *indices,
+			                         unsigned int indexcount,
+			                         const math::Mat4f &transmat);
+			/**
+			 * Removes an occluder from the scene.
+			 * @param handle Handle returned by addOccluder().
+			 */
+			void removeOccluder(unsigned int handle);
+
 			render::SceneFrameData *beginFrame(render::FrameData *frame);
 		private:
-			unsigned int getRenderQueueCount(Camera::Ptr camera);
+			struct ModelInstance
+			{
+				Model::Ptr model;
+				math::Mat4f transmat;
+				math::BoundingBox bounds;
+				/**
+				 * Bounding box after the transformation has been applied.
+				 */
+				math::BoundingBox worldbounds;
+				/**
+				 * Leaf of the instance in the spatial index.
+				 */
+				int leaf;
+			};
+			struct Occluder
+			{
+				std::vector<float> positions;
+				std::vector<unsigned int> indices;
+				math::Mat4f transmat;
+				math::BoundingBox worldbounds;
+				bool used;
+			};
+			class ModelCollector;
+			class QueueFiller;
+
+			unsigned int getRenderQueueCount(Camera::Ptr camera,
+			                                 std::vector<Light::Ptr> &lights);
 			void getForwardLightCount(Camera::Ptr camera,
 			                          std::vector<Light::Ptr> &lights,
 			                          unsigned int &lightcount,
@@ -61,11 +145,23 @@ namespace scene
 			                           std::vector<Light::Ptr> &lights,
 			                           unsigned int &lightcount,
 			                           unsigned int &shadowcount);
+			/**
+			 * Collects the lights which affect a part of the screen of the
+			 * camera.
+			 */
 			void clipLights(Camera::Ptr camera,
 			                std::vector<Light::Ptr> &visible);
+			/**
+			 * Rasterizes all occluders visible to the camera.
+			 * @return Occlusion buffer or 0 if no occluders are visible.
+			 */
+			const render::OcclusionBuffer *drawOccluders(unsigned int cameraindex);
 			unsigned int beginFrame(render::SceneFrameData *frame,
 			                        render::RenderQueue *queue,
 			                        Camera::Ptr camera,
+			                        std::vector<Light::Ptr> &lights,
+			                        const render::OcclusionBuffer *occlusion,
+			                        std::vector<render::RenderCommand*> &querycommands,
 			                        core::MemoryPool *memory);
 
 			static void prepareTextures(render::SceneFrameData *frame,
@@ -82,6 +178,17 @@ namespace scene
 			std::vector<Camera::Ptr> cameras;
 			tbb::mutex lightmutex;
 			std::vector<Light::Ptr> lights;
+			tbb::mutex modelmutex;
+			std::vector<ModelInstance> models;
+			std::vector<unsigned int> freemodels;
+			SpatialIndex modelindex;
+			tbb::mutex occludermutex;
+			std::vector<Occluder> occluders;
+			std::vector<unsigned int> freeoccluders;
+			/**
+			 * Occlusion buffer for every camera, reused every frame.
+			 */
+			std::vector<render::OcclusionBuffer*> occlusionbuffers;
 
 			res::ResourceManager *rmgr;
 
@@ -0,0 +1,174 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _CORERENDER_SCENE_SPATIALINDEX_HPP_INCLUDED_
+#define _CORERENDER_SCENE_SPATIALINDEX_HPP_INCLUDED_
+
+#include "../render/Frustum.hpp"
+
+#include <GameMath.hpp>
+#include <vector>
+
+namespace cr
+{
+namespace scene
+{
+	/**
+	 * Dynamic bounding volume hierarchy (AABB tree) used to find the objects
+	 * within a view frustum without testing every single object.
+	 *
+	 * The leaves store slightly enlarged boxes so that small movements do not
+	 * change the tree at all. Larger movements only refit the boxes of the
+	 * parent nodes, only objects which move to a completely different place
+	 * are removed and inserted again. Whenever the boxes of the parent nodes
+	 * are refitted, subtrees with very different heights are rotated like in
+	 * an AVL tree, so the tree stays balanced even if the objects are
+	 * inserted in spatial order.
+	 *
+	 * The class is not thread-safe, but several threads can call query() at
+	 * the same time as long as the tree is not modified.
+	 */
+	class SpatialIndex
+	{
+		public:
+			SpatialIndex();
+			~SpatialIndex();
+
+			/**
+			 * Inserts a new object into the tree.
+			 * @param box World space bounding box of the object.
+			 * @param userdata Value passed to the callback of query().
+			 * @return Handle of the leaf created for the object.
+			 */
+			int insert(const math::BoundingBox &box, unsigned int userdata);
+			/**
+			 * Removes an object from the tree.
+			 * @param leaf Handle returned by insert().
+			 */
+			void remove(int leaf);
+			/**
+			 * Updates the bounding box of an object.
+			 * @param leaf Handle returned by insert().
+			 * @param box New world space bounding box.
+			 * @return True if the tree had to be changed.
+			 */
+			bool update(int leaf, const math::BoundingBox &box);
+
+			/**
+			 * Calls callback(userdata) for every object which might be
+			 * visible in the frustum. Subtrees which lie completely inside
+			 * the frustum are not tested anymore.
+			 */
+			template<class Callback> void query(const render::Frustum &frustum,
+			                                    Callback &callback) const
+			{
+				if (root == -1)
+					return;
+				struct StackEntry
+				{
+					int node;
+					unsigned int planemask;
+				};
+				std::vector<StackEntry> stack;
+				stack.reserve(64);
+				StackEntry first = {root, render::Frustum::ALL_PLANES};
+				stack.push_back(first);
+				while (!stack.empty())
+				{
+					StackEntry entry = stack.back();
+					stack.pop_back();
+					const Node &node = nodes[entry.node];
+					if (entry.planemask != 0
+					 && !frustum.isVisible(node.box, entry.planemask))
+						continue;
+					if (node.isLeaf())
+					{
+						callback(node.userdata);
+						continue;
+					}
+					StackEntry left = {node.children[0], entry.planemask};
+					StackEntry right = {node.children[1], entry.planemask};
+					stack.push_back(right);
+					stack.push_back(left);
+				}
+			}
+
+			/**
+			 * Returns the number of objects in the tree.
+			 */
+			unsigned int getObjectCount() const
+			{
+				return objectcount;
+			}
+			/**
+			 * Returns the height of the tree, for debugging.
+			 */
+			unsigned int getHeight() const
+			{
+				if (root == -1)
+					return 0;
+				return nodes[root].height + 1;
+			}
+		private:
+			struct Node
+			{
+				bool isLeaf() const
+				{
+					return children[0] == -1;
+				}
+
+				math::BoundingBox box;
+				/**
+				 * Parent node, or the next free node if the node is unused.
+				 */
+				int parent;
+				int children[2];
+				/**
+				 * Height of the subtree, 0 for leaves.
+				 */
+				int height;
+				unsigned int userdata;
+			};
+
+			int allocateNode();
+			void freeNode(int node);
+			void insertLeaf(int leaf);
+			void removeLeaf(int leaf);
+			void refit(int node);
+			int balance(int node);
+			int rotate(int node, unsigned int child);
+
+			static math::BoundingBox enlarge(const math::BoundingBox &box);
+			static bool contains(const math::BoundingBox &outer,
+			                     const math::BoundingBox &inner);
+			static bool overlaps(const math::BoundingBox &a,
+			                     const math::BoundingBox &b);
+			static float getSurfaceArea(const math::BoundingBox &box);
+
+			std::vector<Node> nodes;
+			int root;
+			int freelist;
+			unsigned int objectcount;
+	};
+}
+}
+
+#endif
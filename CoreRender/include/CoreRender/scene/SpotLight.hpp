@@ -66,13 +66,24 @@ namespace scene
 			                               Camera::Ptr camera,
 			                               math::Mat4f *shadowmat,
 			                               render::LightUniforms *uniforms);
-			virtual void getLightQuad(Camera::Ptr camera,
+			virtual bool getLightQuad(Camera::Ptr camera,
 			                          float *quad);
+			virtual bool isVisible(const render::Frustum &frustum);
 
 			virtual void getLightInfo(render::LightUniforms *uniforms);
 
 			typedef core::SharedPointer<SpotLight> Ptr;
 		private:
+			/**
+			 * Computes a cone containing the volume lit by the light.
+			 * @param direction Receives the normalized direction of the cone.
+			 * @return False if the light is too wide to be approximated by a
+			 * cone.
+			 */
+			bool getCone(math::Vec3f &direction,
+			             float &height,
+			             float &baseradius);
+
 			float radius;
 			float angle;
 	};
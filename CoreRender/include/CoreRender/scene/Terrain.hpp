@@ -102,6 +102,24 @@ namespace scene
 			                   unsigned int sizex,
 			                   unsigned int sizez);
 			void updateGeometry(unsigned int patchsize);
+			/**
+			 * Computes the bounding boxes of all quadtree nodes from the
+			 * displacement data. Has to be called after updateGeometry().
+			 */
+			void updateBounds();
+			/**
+			 * Returns the index of a quadtree node in nodebounds.
+			 * @param depth Depth of the node, 0 for the root node.
+			 * @param x Column of the node within its level.
+			 * @param z Row of the node within its level.
+			 */
+			static unsigned int getNodeIndex(unsigned int depth,
+			                                 unsigned int x,
+			                                 unsigned int z)
+			{
+				// All levels above this one contain (4^depth - 1) / 3 nodes
+				return ((1 << (2 * depth)) - 1) / 3 + (z << depth) + x;
+			}
 
 			void renderPatch(render::RenderQueue &queue,
 			                 math::Mat4f transmat,
@@ -111,6 +129,10 @@ namespace scene
 			void renderRecursively(render::RenderQueue &queue,
 			                       math::Mat4f transmat,
 			                       unsigned int maxdepth,
+			                       unsigned int depth,
+			                       unsigned int nodex,
+			                       unsigned int nodez,
+			                       unsigned int planemask,
 			                       math::Vec3f camerapos,
 			                       float *offsetscale,
 			                       render::CustomUniform &texcoordscale);
@@ -125,6 +147,9 @@ namespace scene
 			unsigned int sizez;
 			unsigned int patchsize;
 
+			unsigned int offsetscalename;
+			unsigned int texcoordscalename;
+
 			struct Patch
 			{
 				unsigned int patchsize;
@@ -132,6 +157,13 @@ namespace scene
 				render::Mesh::Ptr mesh;
 			};
 			std::vector<Patch> patches;
+			/**
+			 * Bounding box of every quadtree node in the local coordinate
+			 * system of the terrain, including the displacement and the
+			 * skirts. The nodes are stored level by level, starting with the
+			 * root node, see getNodeIndex().
+			 */
+			std::vector<math::BoundingBox> nodebounds;
 			render::VertexBuffer::Ptr vertices;
 			render::IndexBuffer::Ptr indices;
 			render::VertexLayout::Ptr layout;
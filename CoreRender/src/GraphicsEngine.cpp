@@ -179,7 +179,7 @@ namespace cr
 	};
 
 	GraphicsEngine::GraphicsEngine()
-		: rmgr(0), driver(0)
+		: rmgr(0), driver(0), framememory(0)
 	{
 	}
 	GraphicsEngine::~GraphicsEngine()
@@ -281,6 +281,14 @@ namespace cr
 			deleted = deletionlists.objdeletioncount + deletionlists.resdeletioncount;
 		}
 		while (deleted > 0);
+		// Delete cached frame data
+		for (unsigned int i = 0; i < freeframes.size(); i++)
+		{
+			core::MemoryPool *memory = freeframes[i]->getMemory();
+			delete freeframes[i];
+			delete memory;
+		}
+		freeframes.clear();
 		// Delete driver
 		delete driver;
 		// Stop resource manager
@@ -295,13 +303,34 @@ namespace cr
 
 	render::FrameData *GraphicsEngine::beginFrame()
 	{
-		// TODO: Reuse memory
-		core::MemoryPool *memory = new core::MemoryPool;
+		// Reuse the memory of a previous frame if possible
+		{
+			tbb::mutex::scoped_lock lock(framemutex);
+			if (!freeframes.empty())
+			{
+				render::FrameData *frame = freeframes.back();
+				freeframes.pop_back();
+				lock.release();
+				frame->reset();
+				return frame;
+			}
+		}
+		// Render queues are filled from many threads, so we use thread-local
+		// allocation to prevent lock contention, and the pages are backed by
+		// huge pages if possible to reduce TLB misses
+		core::MemoryPool *memory = new core::MemoryPool(2097152,
+		                                                true,
+		                                                core::MemoryPool::PageFlags::HugePages);
 		render::FrameData *frame = new render::FrameData(memory);
 		return frame;
 	}
 	void GraphicsEngine::endFrame(render::FrameData *frame)
 	{
+		// Sort batches to reduce state changes
+		// This has to be done before the upload lists are created as merging
+		// batches can create new instanced shader combinations which have to
+		// be uploaded before the frame is rendered
+		frame->optimize();
 		// Create lists with resources to be uploaded and deleted
 		uploadmgr.getLists(frame->getUploadLists(), frame->getMemory());
 		frame->endFrame();
@@ -323,12 +352,16 @@ namespace cr
 		driver->endFrame();
 		// Delete resources which need to be deleted
 		uploadmgr.deleteResources(frame->getUploadLists());
-		// Delete frame data
-		core::MemoryPool *memory = frame->getMemory();
+		// Free frame data
 		core::Time composestart = frame->getComposeStartTime();
 		core::Time composeend = frame->getComposeEndTime();
-		delete frame;
-		delete memory;
+		core::MemoryPoolStats framememory;
+		frame->getMemory()->getStats(framememory);
+		unsigned int statechanges = frame->getStateChangeCount();
+		unsigned int unsortedstatechanges = frame->getUnsortedStateChangeCount();
+		unsigned int mergedbatches = frame->getMergedBatchCount();
+		unsigned int occlusionculled = frame->getOcclusionCulledCount();
+		recycleFrame(frame);
 		core::Time renderend = core::Time::Now();
 		// Statistics
 		core::Duration timesincelastframe = renderend - lastframeendtime;
@@ -339,6 +372,11 @@ namespace cr
 		stats.uploadtime = uploadend - uploadstart;
 		stats.rendertime = renderend - renderstart;
 		stats.frametime = stats.composetime + stats.uploadtime + stats.rendertime;
+		stats.framememory = framememory;
+		stats.statechanges = statechanges;
+		stats.unsortedstatechanges = unsortedstatechanges;
+		stats.mergedbatches = mergedbatches;
+		stats.occlusionculled = occlusionculled;
 		// Compute average values (accumulated over 1-2 seconds)
 		frames++;
 		unsigned int accumframes = frames + lastframes;
@@ -378,10 +416,36 @@ namespace cr
 		uploadmgr.uploadResources(frame->getUploadLists());
 		// Delete resources which need to be deleted
 		uploadmgr.deleteResources(frame->getUploadLists());
-		// Delete frame data
+		// Free frame data
+		recycleFrame(frame);
+	}
+
+	void GraphicsEngine::recycleFrame(render::FrameData *frame)
+	{
 		core::MemoryPool *memory = frame->getMemory();
-		delete frame;
-		delete memory;
+		unsigned int size;
+		{
+			// Update the memory high-water mark, the mark decays slowly so
+			// that single large frames do not waste memory forever
+			tbb::mutex::scoped_lock lock(framemutex);
+			framememory -= framememory / 16;
+			unsigned int used = memory->getUsedSize();
+			if (used > framememory)
+				framememory = used;
+			size = framememory;
+			if (freeframes.size() >= FRAME_POOL_SIZE)
+			{
+				lock.release();
+				delete frame;
+				delete memory;
+				return;
+			}
+		}
+		// Free the memory and keep enough pages for the next frame so that
+		// no pages have to be allocated while the frame is composed
+		memory->reset(size);
+		tbb::mutex::scoped_lock lock(framemutex);
+		freeframes.push_back(frame);
 	}
 
 	scene::Model::Ptr GraphicsEngine::getModel(const std::string name)
@@ -413,6 +477,10 @@ namespace cr
 	{
 		return driver->createMesh(uploadmgr);
 	}
+	render::OcclusionQuery::Ptr GraphicsEngine::createOcclusionQuery()
+	{
+		return driver->createOcclusionQuery(uploadmgr);
+	}
 
 	render::Image *GraphicsEngine::takeScreenshot(int x, int y, int width, int height)
 	{
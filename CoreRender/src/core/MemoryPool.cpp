@@ -35,7 +35,62 @@ namespace core
 	void *MemoryPool::allocPage(unsigned int size)
 	{
 #if defined(CORERENDER_UNIX)
-		return mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+		bool hugepage = (pageflags & PageFlags::HugePages) != 0
+		             && size % HUGE_PAGE_SIZE == 0;
+		if (!hugepage)
+		{
+			int flags = MAP_SHARED | MAP_ANON;
+	#if defined(MAP_POPULATE)
+			if (pageflags & PageFlags::Prefault)
+				flags |= MAP_POPULATE;
+	#endif
+			return mmap(0, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		}
+	#if defined(MAP_HUGETLB)
+		// Try to get reserved huge pages first
+		{
+			int flags = MAP_PRIVATE | MAP_ANON | MAP_HUGETLB;
+		#if defined(MAP_POPULATE)
+			if (pageflags & PageFlags::Prefault)
+				flags |= MAP_POPULATE;
+		#endif
+			void *page = mmap(0, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+			if (page != MAP_FAILED)
+			{
+				hugepages += size / HUGE_PAGE_SIZE;
+				return page;
+			}
+		}
+	#endif
+		// No reserved huge pages available, fall back to transparent huge
+		// pages. These have to be aligned to the huge page size, so we
+		// allocate more memory and cut off the unaligned parts
+		char *memory = (char*)mmap(0,
+		                           size + HUGE_PAGE_SIZE,
+		                           PROT_READ | PROT_WRITE,
+		                           MAP_PRIVATE | MAP_ANON,
+		                           -1,
+		                           0);
+		if (memory == MAP_FAILED)
+			return MAP_FAILED;
+		unsigned int offset = (HUGE_PAGE_SIZE - ((size_t)memory & (HUGE_PAGE_SIZE - 1)))
+		                    & (HUGE_PAGE_SIZE - 1);
+		if (offset != 0)
+			munmap(memory, offset);
+		munmap(memory + offset + size, HUGE_PAGE_SIZE - offset);
+		char *page = memory + offset;
+	#if defined(MADV_HUGEPAGE)
+		if (madvise(page, size, MADV_HUGEPAGE) == 0)
+			advisedhugepages += size / HUGE_PAGE_SIZE;
+	#endif
+		if (pageflags & PageFlags::Prefault)
+		{
+			// MAP_POPULATE would have faulted in normal pages before
+			// madvise(), so we touch the memory manually
+			for (unsigned int i = 0; i < size; i += 0x1000)
+				page[i] = 0;
+		}
+		return page;
 #else
 		return malloc(size);
 #endif
@@ -0,0 +1,613 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CoreRender/render/FrameData.hpp"
+#include "CoreRender/render/ShaderCombination.hpp"
+#include "CoreRender/render/Shader.hpp"
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/atomic.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <algorithm>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CORERENDER_SSE_NORMALMAT
+#endif
+
+namespace cr
+{
+namespace render
+{
+	static tbb::atomic<unsigned int> nextframeid;
+	static tbb::atomic<unsigned int> nextthreadslot;
+	static tbb::enumerable_thread_specific<unsigned int> threadslots;
+
+	/**
+	 * Batch together with its sort key so that the key does not have to be
+	 * fetched through the batch pointer during sorting.
+	 */
+	struct SortEntry
+	{
+		math::uint64 key;
+		Batch *batch;
+
+		bool operator<(const SortEntry &other) const
+		{
+			return key < other.key;
+		}
+	};
+
+	/**
+	 * Queues with less batches are sorted with std::stable_sort as the
+	 * histogram passes of the radix sort would dominate.
+	 */
+	static const unsigned int MIN_RADIX_SORT_SIZE = 256;
+	/**
+	 * Minimum number of identical batches which are merged into a single
+	 * instanced batch.
+	 */
+	static const unsigned int MIN_INSTANCE_MERGE_COUNT = 2;
+
+	static unsigned int quantizeDepth(float depth)
+	{
+		if (!(depth > 0.0f))
+			return 0;
+		// The bit pattern of positive floats is monotonic, the upper 16 bits
+		// contain the exponent and give a logarithmic depth distribution
+		union
+		{
+			float f;
+			unsigned int i;
+		} bits;
+		bits.f = depth;
+		return bits.i >> 16;
+	}
+	/**
+	 * Computes the sort key of a batch.
+	 * @param sortmode Sort mode of the queue.
+	 * @param batch Batch to compute the key for.
+	 * @param index Position of the batch in the queue before sorting, used
+	 * to keep blended batches at the same depth in submission order.
+	 */
+	static math::uint64 getSortKey(SortMode::List sortmode,
+	                               Batch *batch,
+	                               unsigned int index)
+	{
+		// Opaque batches are drawn first, then batches with a commutative
+		// blend mode and finally batches which have to be drawn back-to-front
+		unsigned int pass = 0;
+		switch (batch->shader->currentdata.blendmode)
+		{
+			case BlendMode::Replace:
+				pass = 0;
+				break;
+			case BlendMode::Blend:
+			case BlendMode::AddBlended:
+				pass = 2;
+				break;
+			default:
+				pass = 1;
+				break;
+		}
+		// State part of the key: 12 bits shader combination, 16 bits
+		// material, 16 bits mesh
+		math::uint64 state = 0;
+		state |= (math::uint64)(batch->shader->getSortId() & 0xFFF) << 32;
+		state |= (math::uint64)(batch->material->getSortId() & 0xFFFF) << 16;
+		state |= (math::uint64)(batch->mesh->getSortId() & 0xFFFF);
+		math::uint64 depth = quantizeDepth(batch->depth);
+		// Key layout: 4 bits pass, then either 44 bits state and 16 bits
+		// depth or 16 bits depth and 44 bits state
+		math::uint64 key = (math::uint64)pass << 60;
+		// Blended batches are always drawn back-to-front, batches at the same
+		// depth (e.g. GUI elements sharing a transformation) in the order in
+		// which they were added, so they use the submission index instead of
+		// the state
+		if (pass == 2)
+			return key | ((0xFFFF - depth) << 44) | index;
+		switch (sortmode)
+		{
+			case SortMode::FrontToBack:
+				key |= (depth << 44) | state;
+				break;
+			case SortMode::BackToFront:
+				key |= ((0xFFFF - depth) << 44) | state;
+				break;
+			default:
+				key |= (state << 16) | depth;
+				break;
+		}
+		return key;
+	}
+
+	static void radixSort(SortEntry *entries,
+	                      SortEntry *buffer,
+	                      unsigned int count)
+	{
+		// Compute the histograms of all 8 digits in one pass
+		unsigned int histograms[8][256];
+		std::memset(histograms, 0, sizeof(histograms));
+		for (unsigned int i = 0; i < count; i++)
+		{
+			math::uint64 key = entries[i].key;
+			for (unsigned int digit = 0; digit < 8; digit++)
+				histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+		}
+		// Sort by every digit, starting with the least significant one
+		SortEntry *src = entries;
+		SortEntry *dest = buffer;
+		for (unsigned int digit = 0; digit < 8; digit++)
+		{
+			unsigned int *histogram = histograms[digit];
+			// Skip digits which are the same for all batches, this is the case
+			// for most of the high bits
+			unsigned int firstkey = (src[0].key >> (digit * 8)) & 0xFF;
+			if (histogram[firstkey] == count)
+				continue;
+			// Compute the offsets of all buckets
+			unsigned int offset = 0;
+			for (unsigned int i = 0; i < 256; i++)
+			{
+				unsigned int size = histogram[i];
+				histogram[i] = offset;
+				offset += size;
+			}
+			// Scatter the entries
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned int bucket = (src[i].key >> (digit * 8)) & 0xFF;
+				dest[histogram[bucket]++] = src[i];
+			}
+			std::swap(src, dest);
+		}
+		// Make sure the result ends up in the right array
+		if (src != entries)
+			std::memcpy(entries, src, sizeof(SortEntry) * count);
+	}
+
+	static unsigned int countStateChanges(Batch **batches, unsigned int count)
+	{
+		unsigned int changes = 0;
+		for (unsigned int i = 1; i < count; i++)
+		{
+			if (batches[i]->shader != batches[i - 1]->shader)
+				changes++;
+			if (batches[i]->material != batches[i - 1]->material)
+				changes++;
+			if (batches[i]->mesh != batches[i - 1]->mesh)
+				changes++;
+		}
+		return changes;
+	}
+
+	/**
+	 * Returns true if two batches only differ in their transformation matrix
+	 * so that they can be drawn with a single instanced draw call.
+	 */
+	static bool canMergeInstances(Batch *a, Batch *b)
+	{
+		if (a->mesh != b->mesh || a->shader != b->shader
+		 || a->material != b->material)
+			return false;
+		if (b->transmatcount != 0 || b->skinmat || b->scissor)
+			return false;
+		if (a->customuniformcount != b->customuniformcount)
+			return false;
+		// Batches of the same material usually share their uniforms
+		if (a->customuniforms == b->customuniforms)
+			return true;
+		for (unsigned int i = 0; i < a->customuniformcount; i++)
+		{
+			CustomUniform &uniforma = a->customuniforms[i];
+			CustomUniform &uniformb = b->customuniforms[i];
+			if (uniforma.size != uniformb.size)
+				return false;
+			if (uniforma.name != uniformb.name)
+				return false;
+			if (std::memcmp(uniforma.data, uniformb.data,
+			                uniforma.size * sizeof(float)))
+				return false;
+		}
+		return true;
+	}
+	/**
+	 * Returns true if the batch can be part of an automatically created
+	 * instanced batch.
+	 */
+	static bool isInstancingCandidate(Batch *batch)
+	{
+		if (batch->transmatcount != 0 || batch->skinmat || batch->scissor)
+			return false;
+		// The shader combination already has to be a non-instanced one
+		if (batch->shader->instancing || batch->shader->skinning)
+			return false;
+		if (!batch->shader->shader->supportsInstancing())
+			return false;
+		// Instanced drawing is only implemented for indexed triangles
+		if (batch->mesh->getPrimitiveType() != PrimitiveType::Triangle)
+			return false;
+		// Blended geometry has to be drawn in the order it was sorted in
+		BlendMode::List blendmode = batch->shader->currentdata.blendmode;
+		if (blendmode == BlendMode::Blend || blendmode == BlendMode::AddBlended)
+			return false;
+		return true;
+	}
+	/**
+	 * Replaces runs of adjacent batches which only differ in their
+	 * transformation matrix with single instanced batches.
+	 * @return Number of batches which were removed from the queue.
+	 */
+	static unsigned int mergeInstances(RenderQueue *queue)
+	{
+		Batch **batches = queue->batches;
+		unsigned int count = queue->batchcount;
+		unsigned int newcount = 0;
+		unsigned int i = 0;
+		while (i < count)
+		{
+			Batch *first = batches[i];
+			unsigned int end = i + 1;
+			if (isInstancingCandidate(first))
+			{
+				while (end < count && canMergeInstances(first, batches[end]))
+					end++;
+			}
+			unsigned int instancecount = end - i;
+			ShaderCombination *shader = 0;
+			if (instancecount >= MIN_INSTANCE_MERGE_COUNT)
+			{
+				// Get the instancing variant of the shader with the same
+				// compiler flags
+				shader = first->shader->shader->getCombination(queue->context,
+				                                               0xFFFFFFFF,
+				                                               first->shader->compilerflags,
+				                                               true,
+				                                               false).get();
+				if (shader && !shader->instancing)
+					shader = 0;
+			}
+			if (!shader)
+			{
+				// Keep the batches as they are
+				for (unsigned int j = i; j < end; j++)
+					batches[newcount++] = batches[j];
+				i = end;
+				continue;
+			}
+			// Create the instanced batch
+			void *ptr = queue->memory->allocate(sizeof(Batch));
+			Batch *merged = (Batch*)ptr;
+			*merged = *first;
+			merged->shader = shader;
+			merged->transmat = math::Mat4f::Identity();
+			merged->transmatcount = instancecount;
+			merged->transmatlist = queue->memory->allocateArray<math::Mat4f>(instancecount,
+			                                                                 core::MemoryPool::SIMD_ALIGNMENT);
+			for (unsigned int j = 0; j < instancecount; j++)
+				merged->transmatlist[j] = batches[i + j]->transmat;
+			batches[newcount++] = merged;
+			i = end;
+		}
+		queue->batchcount = newcount;
+		return count - newcount;
+	}
+
+	/**
+	 * Computes the inverse transposed matrix of an affine transformation
+	 * matrix, which is used to transform normals.
+	 */
+	static void computeNormalMatrix(const math::Mat4f &transmat,
+	                                math::Mat4f &normalmat)
+	{
+		const float *m = transmat.m;
+		// Cofactors of the upper 3x3 matrix
+		float c00 = m[5] * m[10] - m[9] * m[6];
+		float c01 = m[9] * m[2] - m[1] * m[10];
+		float c02 = m[1] * m[6] - m[5] * m[2];
+		float c10 = m[8] * m[6] - m[4] * m[10];
+		float c11 = m[0] * m[10] - m[8] * m[2];
+		float c12 = m[4] * m[2] - m[0] * m[6];
+		float c20 = m[4] * m[9] - m[8] * m[5];
+		float c21 = m[8] * m[1] - m[0] * m[9];
+		float c22 = m[0] * m[5] - m[4] * m[1];
+		float invdet = 1.0f / (m[0] * c00 + m[4] * c01 + m[8] * c02);
+		float *n = normalmat.m;
+		// The inverse transposed 3x3 matrix is the cofactor matrix divided by
+		// the determinant
+		n[0] = c00 * invdet;
+		n[1] = c10 * invdet;
+		n[2] = c20 * invdet;
+		n[4] = c01 * invdet;
+		n[5] = c11 * invdet;
+		n[6] = c21 * invdet;
+		n[8] = c02 * invdet;
+		n[9] = c12 * invdet;
+		n[10] = c22 * invdet;
+		// The inverted translation ends up in the last row
+		n[3] = -(n[0] * m[12] + n[1] * m[13] + n[2] * m[14]);
+		n[7] = -(n[4] * m[12] + n[5] * m[13] + n[6] * m[14]);
+		n[11] = -(n[8] * m[12] + n[9] * m[13] + n[10] * m[14]);
+		n[12] = 0.0f;
+		n[13] = 0.0f;
+		n[14] = 0.0f;
+		n[15] = 1.0f;
+	}
+	/**
+	 * Computes the normal matrices for a list of transformation matrices.
+	 * Four matrices are processed at once using SSE where available.
+	 */
+	static void computeNormalMatrices(const math::Mat4f **transmat,
+	                                  math::Mat4f *normalmat,
+	                                  unsigned int count)
+	{
+		unsigned int i = 0;
+#ifdef CORERENDER_SSE_NORMALMAT
+		for (; i + 4 <= count; i += 4)
+		{
+			// Load the matrices so that every register contains one element
+			// of all four matrices
+			const float *m0 = transmat[i]->m;
+			const float *m1 = transmat[i + 1]->m;
+			const float *m2 = transmat[i + 2]->m;
+			const float *m3 = transmat[i + 3]->m;
+			__m128 m[15];
+			for (unsigned int j = 0; j < 15; j++)
+				m[j] = _mm_set_ps(m3[j], m2[j], m1[j], m0[j]);
+			// Cofactors of the upper 3x3 matrices
+			__m128 c00 = _mm_sub_ps(_mm_mul_ps(m[5], m[10]), _mm_mul_ps(m[9], m[6]));
+			__m128 c01 = _mm_sub_ps(_mm_mul_ps(m[9], m[2]), _mm_mul_ps(m[1], m[10]));
+			__m128 c02 = _mm_sub_ps(_mm_mul_ps(m[1], m[6]), _mm_mul_ps(m[5], m[2]));
+			__m128 c10 = _mm_sub_ps(_mm_mul_ps(m[8], m[6]), _mm_mul_ps(m[4], m[10]));
+			__m128 c11 = _mm_sub_ps(_mm_mul_ps(m[0], m[10]), _mm_mul_ps(m[8], m[2]));
+			__m128 c12 = _mm_sub_ps(_mm_mul_ps(m[4], m[2]), _mm_mul_ps(m[0], m[6]));
+			__m128 c20 = _mm_sub_ps(_mm_mul_ps(m[4], m[9]), _mm_mul_ps(m[8], m[5]));
+			__m128 c21 = _mm_sub_ps(_mm_mul_ps(m[8], m[1]), _mm_mul_ps(m[0], m[9]));
+			__m128 c22 = _mm_sub_ps(_mm_mul_ps(m[0], m[5]), _mm_mul_ps(m[4], m[1]));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], c00),
+			                                   _mm_mul_ps(m[4], c01)),
+			                        _mm_mul_ps(m[8], c02));
+			__m128 invdet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+			__m128 n[16];
+			n[0] = _mm_mul_ps(c00, invdet);
+			n[1] = _mm_mul_ps(c10, invdet);
+			n[2] = _mm_mul_ps(c20, invdet);
+			n[4] = _mm_mul_ps(c01, invdet);
+			n[5] = _mm_mul_ps(c11, invdet);
+			n[6] = _mm_mul_ps(c21, invdet);
+			n[8] = _mm_mul_ps(c02, invdet);
+			n[9] = _mm_mul_ps(c12, invdet);
+			n[10] = _mm_mul_ps(c22, invdet);
+			__m128 zero = _mm_setzero_ps();
+			for (unsigned int j = 0; j < 3; j++)
+			{
+				__m128 x = _mm_mul_ps(n[j * 4], m[12]);
+				__m128 y = _mm_mul_ps(n[j * 4 + 1], m[13]);
+				__m128 z = _mm_mul_ps(n[j * 4 + 2], m[14]);
+				n[j * 4 + 3] = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(x, y), z));
+			}
+			n[12] = zero;
+			n[13] = zero;
+			n[14] = zero;
+			n[15] = _mm_set1_ps(1.0f);
+			// Transpose back into one matrix per batch
+			for (unsigned int j = 0; j < 16; j += 4)
+			{
+				__m128 r0 = n[j];
+				__m128 r1 = n[j + 1];
+				__m128 r2 = n[j + 2];
+				__m128 r3 = n[j + 3];
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(&normalmat[i].m[j], r0);
+				_mm_storeu_ps(&normalmat[i + 1].m[j], r1);
+				_mm_storeu_ps(&normalmat[i + 2].m[j], r2);
+				_mm_storeu_ps(&normalmat[i + 3].m[j], r3);
+			}
+		}
+#endif
+		for (; i < count; i++)
+			computeNormalMatrix(*transmat[i], normalmat[i]);
+	}
+	/**
+	 * Returns the number of normal matrices the batch needs when it is drawn.
+	 */
+	static unsigned int getNormalMatrixCount(Batch *batch)
+	{
+		// Shaders which have not been compiled yet might need the matrices,
+		// compiled ones only if the linked program uses the uniform
+		if (batch->shader->normalmatrix == NormalMatrixUsage::Unused)
+			return 0;
+		if (batch->transmatcount == 0)
+			return 1;
+		// The instanced path does not use the uniform
+		if (batch->shader->instancing)
+			return 0;
+		return batch->transmatcount;
+	}
+	/**
+	 * Computes the normal matrices of all batches in the queue.
+	 */
+	static void prepareNormalMatrices(RenderQueue *queue)
+	{
+		// Collect the transformation matrices of all batches
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < queue->batchcount; i++)
+			count += getNormalMatrixCount(queue->batches[i]);
+		if (count == 0)
+			return;
+		core::MemoryPool *memory = queue->memory;
+		const math::Mat4f **transmat;
+		transmat = memory->allocateArray<const math::Mat4f*>(count);
+		math::Mat4f *normalmat;
+		normalmat = memory->allocateArray<math::Mat4f>(count,
+		                                               core::MemoryPool::SIMD_ALIGNMENT);
+		unsigned int current = 0;
+		for (unsigned int i = 0; i < queue->batchcount; i++)
+		{
+			Batch *batch = queue->batches[i];
+			unsigned int batchcount = getNormalMatrixCount(batch);
+			if (batchcount == 0)
+				continue;
+			batch->normalmat = &normalmat[current];
+			if (batch->transmatcount == 0)
+			{
+				transmat[current] = &batch->transmat;
+			}
+			else
+			{
+				for (unsigned int j = 0; j < batchcount; j++)
+					transmat[current + j] = &batch->transmatlist[j];
+			}
+			current += batchcount;
+		}
+		// Compute them all at once
+		computeNormalMatrices(transmat, normalmat, count);
+	}
+
+	class QueueSorter
+	{
+		public:
+			QueueSorter(RenderQueue **queues,
+			            tbb::atomic<unsigned int> &statechanges,
+			            tbb::atomic<unsigned int> &unsortedstatechanges,
+			            tbb::atomic<unsigned int> &mergedbatches)
+				: queues(queues), statechanges(statechanges),
+				unsortedstatechanges(unsortedstatechanges),
+				mergedbatches(mergedbatches)
+			{
+			}
+
+			void operator()(const tbb::blocked_range<unsigned int> &range) const
+			{
+				for (unsigned int i = range.begin(); i != range.end(); i++)
+					sortQueue(queues[i]);
+			}
+		private:
+			void sortQueue(RenderQueue *queue) const
+			{
+				// Collect the batches from all threads
+				queue->mergeBatches();
+				sortBatches(queue);
+				prepareNormalMatrices(queue);
+			}
+			void sortBatches(RenderQueue *queue) const
+			{
+				Batch **batches = queue->batches;
+				unsigned int count = queue->batchcount;
+				if (count < 2)
+					return;
+				unsigned int changes = countStateChanges(batches, count);
+				unsortedstatechanges += changes;
+				if (queue->sortmode == SortMode::None)
+				{
+					statechanges += changes;
+					return;
+				}
+				// Compute the sort keys
+				SortEntry *entries;
+				entries = queue->memory->allocateArray<SortEntry>(count);
+				for (unsigned int i = 0; i < count; i++)
+				{
+					batches[i]->sortkey = getSortKey(queue->sortmode, batches[i], i);
+					entries[i].key = batches[i]->sortkey;
+					entries[i].batch = batches[i];
+				}
+				// Sort the batches
+				// Both sorts are stable, so the order of batches with equal
+				// keys does not depend on the size of the queue. Blended
+				// batches never have equal keys as their keys contain the
+				// position of the batch in the queue.
+				if (count < MIN_RADIX_SORT_SIZE)
+				{
+					std::stable_sort(entries, entries + count);
+				}
+				else
+				{
+					SortEntry *buffer;
+					buffer = queue->memory->allocateArray<SortEntry>(count);
+					radixSort(entries, buffer, count);
+				}
+				for (unsigned int i = 0; i < count; i++)
+					batches[i] = entries[i].batch;
+				// Identical batches are now next to each other and can be
+				// drawn with a single instanced draw call
+				if (queue->sortmode == SortMode::State)
+				{
+					mergedbatches += mergeInstances(queue);
+					count = queue->batchcount;
+				}
+				statechanges += countStateChanges(batches, count);
+			}
+
+			RenderQueue **queues;
+			tbb::atomic<unsigned int> &statechanges;
+			tbb::atomic<unsigned int> &unsortedstatechanges;
+			tbb::atomic<unsigned int> &mergedbatches;
+	};
+
+	unsigned int RenderQueue::getThreadSlot()
+	{
+		bool exists;
+		unsigned int &slot = threadslots.local(exists);
+		if (!exists)
+			slot = nextthreadslot++;
+		return slot;
+	}
+
+	unsigned int FrameData::getNextFrameId()
+	{
+		unsigned int id = ++nextframeid;
+		// 0 is used by materials to mark invalid snapshots
+		if (id == 0)
+			id = ++nextframeid;
+		return id;
+	}
+
+	void FrameData::optimize()
+	{
+		// Collect the render queues of all scenes
+		std::vector<RenderQueue*> queues;
+		for (unsigned int i = 0; i < scenes.size(); i++)
+		{
+			for (unsigned int j = 0; j < scenes[i]->getRenderQueueCount(); j++)
+				queues.push_back(scenes[i]->getRenderQueue(j));
+		}
+		if (queues.empty())
+			return;
+		// Sort the queues in parallel
+		tbb::atomic<unsigned int> sortedchanges;
+		sortedchanges = 0;
+		tbb::atomic<unsigned int> unsortedchanges;
+		unsortedchanges = 0;
+		tbb::atomic<unsigned int> merged;
+		merged = 0;
+		tbb::parallel_for(tbb::blocked_range<unsigned int>(0, queues.size()),
+		                  QueueSorter(&queues[0],
+		                              sortedchanges,
+		                              unsortedchanges,
+		                              merged),
+		                  tbb::simple_partitioner());
+		statechanges = sortedchanges;
+		unsortedstatechanges = unsortedchanges;
+		mergedbatches = merged;
+	}
+}
+}
@@ -0,0 +1,317 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CoreRender/render/Frustum.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CORERENDER_SSE_CULLING
+#endif
+
+namespace cr
+{
+namespace render
+{
+	void Frustum::setMatrix(const math::Mat4f &viewproj)
+	{
+		// Every plane is the sum or difference of the last row and one of the
+		// other rows of the (column-major) matrix
+		const float *m = viewproj.m;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			for (unsigned int j = 0; j < 4; j++)
+			{
+				planes[i * 2][j] = m[j * 4 + 3] + m[j * 4 + i];
+				planes[i * 2 + 1][j] = m[j * 4 + 3] - m[j * 4 + i];
+			}
+		}
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			float length = std::sqrt(planes[i][0] * planes[i][0]
+			                       + planes[i][1] * planes[i][1]
+			                       + planes[i][2] * planes[i][2]);
+			if (length == 0.0f)
+				continue;
+			for (unsigned int j = 0; j < 4; j++)
+				planes[i][j] /= length;
+		}
+		enabled = true;
+	}
+
+	bool Frustum::isVisible(const math::BoundingBox &box,
+	                        const math::Mat4f &transmat) const
+	{
+		if (!enabled)
+			return true;
+		// Transform center and extents of the box
+		math::Vec3f center = (box.minCorner + box.maxCorner) * 0.5f;
+		math::Vec3f extents = (box.maxCorner - box.minCorner) * 0.5f;
+		const float *m = transmat.m;
+		float worldcenter[3];
+		float worldextents[3];
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			worldcenter[i] = m[i] * center.x + m[4 + i] * center.y
+			               + m[8 + i] * center.z + m[12 + i];
+			worldextents[i] = std::fabs(m[i]) * extents.x
+			                + std::fabs(m[4 + i]) * extents.y
+			                + std::fabs(m[8 + i]) * extents.z;
+		}
+		// The box is outside if it lies completely behind one of the planes
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			const float *plane = planes[i];
+			float distance = plane[0] * worldcenter[0]
+			               + plane[1] * worldcenter[1]
+			               + plane[2] * worldcenter[2]
+			               + plane[3];
+			float radius = std::fabs(plane[0]) * worldextents[0]
+			             + std::fabs(plane[1]) * worldextents[1]
+			             + std::fabs(plane[2]) * worldextents[2];
+			if (distance + radius < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	bool Frustum::isVisible(const math::BoundingBox &box,
+	                        unsigned int &planemask) const
+	{
+		if (!enabled)
+		{
+			planemask = 0;
+			return true;
+		}
+		math::Vec3f center = (box.minCorner + box.maxCorner) * 0.5f;
+		math::Vec3f extents = (box.maxCorner - box.minCorner) * 0.5f;
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			if (!(planemask & (1 << i)))
+				continue;
+			const float *plane = planes[i];
+			float distance = plane[0] * center.x
+			               + plane[1] * center.y
+			               + plane[2] * center.z
+			               + plane[3];
+			float radius = std::fabs(plane[0]) * extents.x
+			             + std::fabs(plane[1]) * extents.y
+			             + std::fabs(plane[2]) * extents.z;
+			if (distance + radius < 0.0f)
+				return false;
+			if (distance - radius >= 0.0f)
+				planemask &= ~(1 << i);
+		}
+		return true;
+	}
+	bool Frustum::intersectsNearPlane(const math::BoundingBox &box) const
+	{
+		// The near plane is the fifth plane (last row plus third row)
+		unsigned int planemask = 1 << 4;
+		if (!isVisible(box, planemask))
+			return false;
+		return planemask != 0;
+	}
+	bool Frustum::isSphereVisible(const math::Vec3f &center, float radius) const
+	{
+		if (!enabled)
+			return true;
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			const float *plane = planes[i];
+			float distance = plane[0] * center.x
+			               + plane[1] * center.y
+			               + plane[2] * center.z
+			               + plane[3];
+			if (distance < -radius)
+				return false;
+		}
+		return true;
+	}
+	bool Frustum::isConeVisible(const math::Vec3f &apex,
+	                            const math::Vec3f &direction,
+	                            float height,
+	                            float baseradius) const
+	{
+		if (!enabled)
+			return true;
+		math::Vec3f basecenter = apex + direction * height;
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			const float *plane = planes[i];
+			float apexdistance = plane[0] * apex.x
+			                   + plane[1] * apex.y
+			                   + plane[2] * apex.z
+			                   + plane[3];
+			if (apexdistance >= 0.0f)
+				continue;
+			// The point of the base circle furthest inside is found by moving
+			// from the center along the part of the plane normal which is
+			// perpendicular to the axis
+			float normaldotaxis = plane[0] * direction.x
+			                    + plane[1] * direction.y
+			                    + plane[2] * direction.z;
+			math::Vec3f perpendicular(plane[0] - direction.x * normaldotaxis,
+			                          plane[1] - direction.y * normaldotaxis,
+			                          plane[2] - direction.z * normaldotaxis);
+			float length = std::sqrt(perpendicular.x * perpendicular.x
+			                       + perpendicular.y * perpendicular.y
+			                       + perpendicular.z * perpendicular.z);
+			math::Vec3f furthest = basecenter;
+			if (length > 0.0f)
+				furthest = furthest + perpendicular * (baseradius / length);
+			float basedistance = plane[0] * furthest.x
+			                   + plane[1] * furthest.y
+			                   + plane[2] * furthest.z
+			                   + plane[3];
+			if (basedistance < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	unsigned int Frustum::cullInstances(const math::BoundingBox &box,
+	                                    const math::Mat4f *transmat,
+	                                    unsigned int count,
+	                                    math::Mat4f *visible) const
+	{
+		if (!enabled)
+		{
+			if (visible != transmat)
+				memmove(visible, transmat, count * sizeof(math::Mat4f));
+			return count;
+		}
+		unsigned int visiblecount = 0;
+		unsigned int i = 0;
+#ifdef CORERENDER_SSE_CULLING
+		// The planes are stored as structure-of-arrays so that every plane
+		// can be tested against four instances at once
+		__m128 signmask = _mm_set1_ps(-0.0f);
+		__m128 planecoeff[6][4];
+		__m128 planeabs[6][3];
+		for (unsigned int j = 0; j < 6; j++)
+		{
+			for (unsigned int k = 0; k < 4; k++)
+				planecoeff[j][k] = _mm_set1_ps(planes[j][k]);
+			for (unsigned int k = 0; k < 3; k++)
+				planeabs[j][k] = _mm_andnot_ps(signmask, planecoeff[j][k]);
+		}
+		math::Vec3f center = (box.minCorner + box.maxCorner) * 0.5f;
+		math::Vec3f extents = (box.maxCorner - box.minCorner) * 0.5f;
+		__m128 cx = _mm_set1_ps(center.x);
+		__m128 cy = _mm_set1_ps(center.y);
+		__m128 cz = _mm_set1_ps(center.z);
+		__m128 ex = _mm_set1_ps(extents.x);
+		__m128 ey = _mm_set1_ps(extents.y);
+		__m128 ez = _mm_set1_ps(extents.z);
+		for (; i + 4 <= count; i += 4)
+		{
+			// Transform center and extents of the box for four instances
+			__m128 wc[4];
+			__m128 we[4];
+			for (unsigned int k = 0; k < 4; k++)
+			{
+				const float *m = transmat[i + k].m;
+				__m128 col0 = _mm_loadu_ps(m);
+				__m128 col1 = _mm_loadu_ps(m + 4);
+				__m128 col2 = _mm_loadu_ps(m + 8);
+				__m128 col3 = _mm_loadu_ps(m + 12);
+				wc[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(col0, cx),
+				                              _mm_mul_ps(col1, cy)),
+				                   _mm_add_ps(_mm_mul_ps(col2, cz), col3));
+				we[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signmask, col0), ex),
+				                              _mm_mul_ps(_mm_andnot_ps(signmask, col1), ey)),
+				                   _mm_mul_ps(_mm_andnot_ps(signmask, col2), ez));
+			}
+			// Convert to structure-of-arrays layout, afterwards wc[0]
+			// contains the x coordinates of all four instances etc.
+			_MM_TRANSPOSE4_PS(wc[0], wc[1], wc[2], wc[3]);
+			_MM_TRANSPOSE4_PS(we[0], we[1], we[2], we[3]);
+			// An instance is culled if its box lies behind one of the planes
+			__m128 outside = _mm_setzero_ps();
+			for (unsigned int j = 0; j < 6; j++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planecoeff[j][0], wc[0]),
+				                                        _mm_mul_ps(planecoeff[j][1], wc[1])),
+				                             _mm_add_ps(_mm_mul_ps(planecoeff[j][2], wc[2]),
+				                                        planecoeff[j][3]));
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeabs[j][0], we[0]),
+				                                      _mm_mul_ps(planeabs[j][1], we[1])),
+				                           _mm_mul_ps(planeabs[j][2], we[2]));
+				outside = _mm_or_ps(outside,
+				                    _mm_cmplt_ps(_mm_add_ps(distance, radius),
+				                                 _mm_setzero_ps()));
+			}
+			int mask = _mm_movemask_ps(outside);
+			if (mask == 0 && visible == transmat && visiblecount == i)
+			{
+				// Nothing culled so far, the list does not need to be moved
+				visiblecount += 4;
+				continue;
+			}
+			for (unsigned int k = 0; k < 4; k++)
+			{
+				if (!(mask & (1 << k)))
+					visible[visiblecount++] = transmat[i + k];
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			if (isVisible(box, transmat[i]))
+				visible[visiblecount++] = transmat[i];
+		}
+		return visiblecount;
+	}
+
+	math::BoundingBox Frustum::transformBox(const math::BoundingBox &box,
+	                                        const math::Mat4f &transmat)
+	{
+		math::Vec3f center = (box.minCorner + box.maxCorner) * 0.5f;
+		math::Vec3f extents = (box.maxCorner - box.minCorner) * 0.5f;
+		math::Vec3f newcenter = transmat.transformPoint(center);
+		const float *m = transmat.m;
+		math::Vec3f newextents(std::fabs(m[0]) * extents.x
+		                     + std::fabs(m[4]) * extents.y
+		                     + std::fabs(m[8]) * extents.z,
+		                       std::fabs(m[1]) * extents.x
+		                     + std::fabs(m[5]) * extents.y
+		                     + std::fabs(m[9]) * extents.z,
+		                       std::fabs(m[2]) * extents.x
+		                     + std::fabs(m[6]) * extents.y
+		                     + std::fabs(m[10]) * extents.z);
+		return math::BoundingBox(newcenter - newextents, newcenter + newextents);
+	}
+	math::BoundingBox Frustum::mergeBoxes(const math::BoundingBox &a,
+	                                      const math::BoundingBox &b)
+	{
+		math::Vec3f mincorner(std::min(a.minCorner.x, b.minCorner.x),
+		                      std::min(a.minCorner.y, b.minCorner.y),
+		                      std::min(a.minCorner.z, b.minCorner.z));
+		math::Vec3f maxcorner(std::max(a.maxCorner.x, b.maxCorner.x),
+		                      std::max(a.maxCorner.y, b.maxCorner.y),
+		                      std::max(a.maxCorner.z, b.maxCorner.z));
+		return math::BoundingBox(mincorner, maxcorner);
+	}
+}
+}
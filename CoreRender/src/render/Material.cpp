@@ -22,6 +22,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/render/Material.hpp"
 #include "CoreRender/res/ResourceManager.hpp"
 #include "CoreRender/render/Texture.hpp"
+#include "CoreRender/render/FrameData.hpp"
+#include "CoreRender/core/MemoryPool.hpp"
 #include "../3rdparty/tinyxml.h"
 
 #include <sstream>
@@ -34,7 +36,8 @@ namespace render
 	                   res::ResourceManager *rmgr,
 	                   const std::string &name)
 		: RenderResource(uploadmgr, rmgr, name), shaderflagmask(0),
-		shaderflagvalue(0), uploadeddata(0)
+		shaderflagvalue(0), snapshotframe(0), snapshot(0), snapshotcount(0),
+		uploadeddata(0)
 	{
 	}
 	Material::~Material()
@@ -99,6 +102,9 @@ namespace render
 			                              getName().c_str());
 			return;
 		}
+		tbb::spin_mutex::scoped_lock lock(uniformmutex);
+		// The snapshot of the current frame does not contain the change
+		snapshotframe = 0;
 		// Search for an existing entry in the uniform list
 		// This currently does not use a hash map or sth like that because of
 		// the low number of uniforms which are usually used
@@ -114,12 +120,15 @@ namespace render
 		// If the uniform was not found, create a new list entry
 		UniformInfo uniform;
 		uniform.name = name;
+		uniform.handle = getManager()->getNameRegistry().getUniform(name);
 		uniform.size = size;
 		memcpy(uniform.data, data, size * sizeof(float));
 		uniforms.push_back(uniform);
 	}
 	void Material::removeUniform(std::string name)
 	{
+		tbb::spin_mutex::scoped_lock lock(uniformmutex);
+		snapshotframe = 0;
 		for (unsigned int i = 0; i < uniforms.size(); i++)
 		{
 			if (uniforms[i].name == name)
@@ -131,6 +140,38 @@ namespace render
 		}
 	}
 
+	CustomUniform *Material::getUniformSnapshot(core::MemoryPool *memory,
+	                                            unsigned int frameid,
+	                                            unsigned int &count)
+	{
+		tbb::spin_mutex::scoped_lock lock(uniformmutex);
+		if (snapshotframe != frameid)
+		{
+			// Copy all uniforms into a single block of frame memory
+			snapshotcount = uniforms.size();
+			snapshot = 0;
+			if (snapshotcount > 0)
+			{
+				unsigned int floatcount = 0;
+				for (unsigned int i = 0; i < uniforms.size(); i++)
+					floatcount += uniforms[i].size;
+				snapshot = memory->allocateArray<CustomUniform>(snapshotcount);
+				float *data = memory->allocateArray<float>(floatcount);
+				for (unsigned int i = 0; i < uniforms.size(); i++)
+				{
+					snapshot[i].name = uniforms[i].handle;
+					snapshot[i].size = uniforms[i].size;
+					snapshot[i].data = data;
+					memcpy(data, uniforms[i].data, uniforms[i].size * sizeof(float));
+					data += uniforms[i].size;
+				}
+			}
+			snapshotframe = frameid;
+		}
+		count = snapshotcount;
+		return snapshot;
+	}
+
 	bool Material::load()
 	{
 		std::string path = getPath();
@@ -0,0 +1,325 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CoreRender/render/OcclusionBuffer.hpp"
+#include "CoreRender/render/Frustum.hpp"
+
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CORERENDER_SSE_RASTERIZER
+#endif
+
+namespace cr
+{
+namespace render
+{
+	OcclusionBuffer::OcclusionBuffer(unsigned int width, unsigned int height)
+		: width((std::max(width, 4u) + 3) & ~3), height(std::max(height, 1u)),
+		occludertriangles(0)
+	{
+		// Create the depth hierarchy, every level contains the maximum depth
+		// of 2x2 texels of the level below
+		unsigned int levelwidth = this->width;
+		unsigned int levelheight = this->height;
+		while (true)
+		{
+			Level level;
+			level.width = levelwidth;
+			level.height = levelheight;
+			level.depth.resize(levelwidth * levelheight, 1.0f);
+			levels.push_back(level);
+			if (levelwidth == 1 && levelheight == 1)
+				break;
+			levelwidth = std::max((levelwidth + 1) / 2, 1u);
+			levelheight = std::max((levelheight + 1) / 2, 1u);
+		}
+		viewproj = math::Mat4f::Identity();
+	}
+	OcclusionBuffer::~OcclusionBuffer()
+	{
+	}
+
+	void OcclusionBuffer::clear(const math::Mat4f &viewproj)
+	{
+		this->viewproj = viewproj;
+		std::fill(levels[0].depth.begin(), levels[0].depth.end(), 1.0f);
+		occludertriangles = 0;
+	}
+	void OcclusionBuffer::drawOccluder(const float *positions,
+	                                   unsigned int vertexcount,
+	                                   const unsigned int *indices,
+	                                   unsigned int indexcount,
+	                                   const math::Mat4f &transmat)
+	{
+		// Transform the vertices into screen space
+		math::Mat4f mat = viewproj * transmat;
+		const float *m = mat.m;
+		screenvertices.resize(vertexcount * 4);
+		for (unsigned int i = 0; i < vertexcount; i++)
+		{
+			const float *pos = &positions[i * 3];
+			float x = m[0] * pos[0] + m[4] * pos[1] + m[8] * pos[2] + m[12];
+			float y = m[1] * pos[0] + m[5] * pos[1] + m[9] * pos[2] + m[13];
+			float z = m[2] * pos[0] + m[6] * pos[1] + m[10] * pos[2] + m[14];
+			float w = m[3] * pos[0] + m[7] * pos[1] + m[11] * pos[2] + m[15];
+			float *screen = &screenvertices[i * 4];
+			// Vertices in front of the near plane cannot be projected, the
+			// triangles using them are skipped which is conservative
+			if (w <= 0.0f || z < -w)
+			{
+				screen[3] = 0.0f;
+				continue;
+			}
+			screen[0] = (x / w * 0.5f + 0.5f) * width;
+			screen[1] = (y / w * 0.5f + 0.5f) * height;
+			screen[2] = z / w;
+			screen[3] = 1.0f;
+		}
+		// Rasterize the triangles
+		for (unsigned int i = 0; i + 2 < indexcount; i += 3)
+		{
+			if (indices[i] >= vertexcount
+			 || indices[i + 1] >= vertexcount
+			 || indices[i + 2] >= vertexcount)
+				continue;
+			const float *v0 = &screenvertices[indices[i] * 4];
+			const float *v1 = &screenvertices[indices[i + 1] * 4];
+			const float *v2 = &screenvertices[indices[i + 2] * 4];
+			if (v0[3] == 0.0f || v1[3] == 0.0f || v2[3] == 0.0f)
+				continue;
+			drawTriangle(v0, v1, v2);
+		}
+	}
+	void OcclusionBuffer::buildHierarchy()
+	{
+		for (unsigned int i = 1; i < levels.size(); i++)
+		{
+			const Level &src = levels[i - 1];
+			Level &dest = levels[i];
+			for (unsigned int y = 0; y < dest.height; y++)
+			{
+				unsigned int y0 = y * 2;
+				unsigned int y1 = std::min(y0 + 1, src.height - 1);
+				for (unsigned int x = 0; x < dest.width; x++)
+				{
+					unsigned int x0 = x * 2;
+					unsigned int x1 = std::min(x0 + 1, src.width - 1);
+					float depth = std::max(std::max(src.depth[y0 * src.width + x0],
+					                                src.depth[y0 * src.width + x1]),
+					                       std::max(src.depth[y1 * src.width + x0],
+					                                src.depth[y1 * src.width + x1]));
+					dest.depth[y * dest.width + x] = depth;
+				}
+			}
+		}
+	}
+
+	bool OcclusionBuffer::isVisible(const math::BoundingBox &box) const
+	{
+		if (occludertriangles == 0)
+			return true;
+		// Compute the screen space rectangle and the minimum depth of the box
+		const float *m = viewproj.m;
+		float minx = (float)width;
+		float miny = (float)height;
+		float maxx = 0.0f;
+		float maxy = 0.0f;
+		float mindepth = 1.0f;
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			float x = (i & 1) ? box.maxCorner.x : box.minCorner.x;
+			float y = (i & 2) ? box.maxCorner.y : box.minCorner.y;
+			float z = (i & 4) ? box.maxCorner.z : box.minCorner.z;
+			float clipx = m[0] * x + m[4] * y + m[8] * z + m[12];
+			float clipy = m[1] * x + m[5] * y + m[9] * z + m[13];
+			float clipz = m[2] * x + m[6] * y + m[10] * z + m[14];
+			float clipw = m[3] * x + m[7] * y + m[11] * z + m[15];
+			// Boxes intersecting the near plane are always visible
+			if (clipw <= 0.0f || clipz < -clipw)
+				return true;
+			float screenx = (clipx / clipw * 0.5f + 0.5f) * width;
+			float screeny = (clipy / clipw * 0.5f + 0.5f) * height;
+			minx = std::min(minx, screenx);
+			miny = std::min(miny, screeny);
+			maxx = std::max(maxx, screenx);
+			maxy = std::max(maxy, screeny);
+			mindepth = std::min(mindepth, clipz / clipw);
+		}
+		// Boxes outside of the screen are left to frustum culling
+		if (maxx < 0.0f || maxy < 0.0f
+		 || minx >= (float)width || miny >= (float)height)
+			return true;
+		int x0 = std::max((int)std::floor(minx), 0);
+		int y0 = std::max((int)std::floor(miny), 0);
+		int x1 = std::min((int)std::floor(maxx), (int)width - 1);
+		int y1 = std::min((int)std::floor(maxy), (int)height - 1);
+		// Select the level at which the rectangle covers at most 4x4 texels
+		unsigned int level = 0;
+		while (level + 1 < levels.size() && (x1 - x0 > 3 || y1 - y0 > 3))
+		{
+			x0 >>= 1;
+			y0 >>= 1;
+			x1 >>= 1;
+			y1 >>= 1;
+			level++;
+		}
+		// The box is hidden if it is behind the occluders in all texels
+		const Level &current = levels[level];
+		for (int y = y0; y <= y1; y++)
+		{
+			const float *row = &current.depth[y * current.width];
+			for (int x = x0; x <= x1; x++)
+			{
+				if (mindepth <= row[x])
+					return true;
+			}
+		}
+		return false;
+	}
+	unsigned int OcclusionBuffer::cullInstances(const math::BoundingBox &box,
+	                                            const math::Mat4f *transmat,
+	                                            unsigned int count,
+	                                            math::Mat4f *visible) const
+	{
+		if (occludertriangles == 0)
+		{
+			if (visible != transmat)
+			{
+				for (unsigned int i = 0; i < count; i++)
+					visible[i] = transmat[i];
+			}
+			return count;
+		}
+		unsigned int visiblecount = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (isVisible(Frustum::transformBox(box, transmat[i])))
+				visible[visiblecount++] = transmat[i];
+		}
+		return visiblecount;
+	}
+
+	void OcclusionBuffer::drawTriangle(const float *v0,
+	                                   const float *v1,
+	                                   const float *v2)
+	{
+		// Make the triangle counter-clockwise so that all edge functions are
+		// positive inside
+		float area = (v1[0] - v0[0]) * (v2[1] - v0[1])
+		           - (v1[1] - v0[1]) * (v2[0] - v0[0]);
+		if (std::fabs(area) < 1.0e-6f)
+			return;
+		if (area < 0.0f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+		// Bounding rectangle
+		float minx = std::min(std::min(v0[0], v1[0]), v2[0]);
+		float miny = std::min(std::min(v0[1], v1[1]), v2[1]);
+		float maxx = std::max(std::max(v0[0], v1[0]), v2[0]);
+		float maxy = std::max(std::max(v0[1], v1[1]), v2[1]);
+		if (maxx < 0.0f || maxy < 0.0f
+		 || minx >= (float)width || miny >= (float)height)
+			return;
+		int x0 = std::max((int)std::floor(minx), 0) & ~3;
+		int y0 = std::max((int)std::floor(miny), 0);
+		int x1 = std::min((int)std::ceil(maxx), (int)width - 1);
+		int y1 = std::min((int)std::ceil(maxy), (int)height - 1);
+		occludertriangles++;
+		// Edge functions e = a * x + b * y + c for the edges v0v1, v1v2 and
+		// v2v0, and the depth as a linear function of the screen position
+		const float *vertices[3] = {v0, v1, v2};
+		float edgea[3];
+		float edgeb[3];
+		float edgec[3];
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			const float *a = vertices[i];
+			const float *b = vertices[(i + 1) % 3];
+			edgea[i] = a[1] - b[1];
+			edgeb[i] = b[0] - a[0];
+			edgec[i] = (b[1] - a[1]) * a[0] - (b[0] - a[0]) * a[1];
+		}
+		// The barycentric coordinates of v1 and v2 are e2 / area and
+		// e0 / area
+		float invarea = 1.0f / area;
+		float deptha = ((v1[2] - v0[2]) * edgea[2] + (v2[2] - v0[2]) * edgea[0]) * invarea;
+		float depthb = ((v1[2] - v0[2]) * edgeb[2] + (v2[2] - v0[2]) * edgeb[0]) * invarea;
+		float depthc = v0[2] + ((v1[2] - v0[2]) * edgec[2] + (v2[2] - v0[2]) * edgec[0]) * invarea;
+		std::vector<float> &depth = levels[0].depth;
+#ifdef CORERENDER_SSE_RASTERIZER
+		__m128 offset = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		__m128 ea0 = _mm_set1_ps(edgea[0]);
+		__m128 ea1 = _mm_set1_ps(edgea[1]);
+		__m128 ea2 = _mm_set1_ps(edgea[2]);
+		__m128 da = _mm_set1_ps(deptha);
+		__m128 zero = _mm_setzero_ps();
+		for (int y = y0; y <= y1; y++)
+		{
+			float py = (float)y + 0.5f;
+			__m128 rowe0 = _mm_set1_ps(edgeb[0] * py + edgec[0]);
+			__m128 rowe1 = _mm_set1_ps(edgeb[1] * py + edgec[1]);
+			__m128 rowe2 = _mm_set1_ps(edgeb[2] * py + edgec[2]);
+			__m128 rowdepth = _mm_set1_ps(depthb * py + depthc);
+			float *row = &depth[y * width];
+			for (int x = x0; x <= x1; x += 4)
+			{
+				// Test four pixels against all edges at once
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offset);
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(ea0, px), rowe0);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(ea1, px), rowe1);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(ea2, px), rowe2);
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero),
+				                                      _mm_cmpge_ps(e1, zero)),
+				                           _mm_cmpge_ps(e2, zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+				__m128 pixeldepth = _mm_add_ps(_mm_mul_ps(da, px), rowdepth);
+				__m128 olddepth = _mm_loadu_ps(&row[x]);
+				__m128 newdepth = _mm_min_ps(olddepth, pixeldepth);
+				newdepth = _mm_or_ps(_mm_and_ps(inside, newdepth),
+				                     _mm_andnot_ps(inside, olddepth));
+				_mm_storeu_ps(&row[x], newdepth);
+			}
+		}
+#else
+		for (int y = y0; y <= y1; y++)
+		{
+			float py = (float)y + 0.5f;
+			float *row = &depth[y * width];
+			for (int x = x0; x <= x1; x++)
+			{
+				float px = (float)x + 0.5f;
+				if (edgea[0] * px + edgeb[0] * py + edgec[0] < 0.0f
+				 || edgea[1] * px + edgeb[1] * py + edgec[1] < 0.0f
+				 || edgea[2] * px + edgeb[2] * py + edgec[2] < 0.0f)
+					continue;
+				float pixeldepth = deptha * px + depthb * py + depthc;
+				row[x] = std::min(row[x], pixeldepth);
+			}
+		}
+#endif
+	}
+}
+}
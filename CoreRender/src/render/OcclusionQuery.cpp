@@ -0,0 +1,98 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CoreRender/render/OcclusionQuery.hpp"
+#include "CoreRender/core/MemoryPool.hpp"
+
+namespace cr
+{
+namespace render
+{
+	OcclusionQuery::OcclusionQuery(UploadManager &uploadmgr)
+		: RenderObject(uploadmgr), frame(0)
+	{
+	}
+	OcclusionQuery::~OcclusionQuery()
+	{
+	}
+
+	void OcclusionQuery::update()
+	{
+		frame++;
+		tbb::spin_mutex::scoped_lock lock(pendingmutex);
+		for (unsigned int i = 0; i < pending.size(); i++)
+		{
+			const PendingResult &result = pending[i];
+			if (result.object >= results.size())
+			{
+				Result unknown;
+				unknown.frame = 0;
+				unknown.visible = true;
+				results.resize(result.object + 1, unknown);
+			}
+			// Results of older queries might arrive after newer ones if the
+			// object was queried by several frames in flight
+			if (result.frame < results[result.object].frame)
+				continue;
+			results[result.object].frame = result.frame;
+			results[result.object].visible = result.visible;
+		}
+		pending.clear();
+	}
+
+	void OcclusionQuery::addRequest(unsigned int object,
+	                                const math::BoundingBox &box)
+	{
+		Request request;
+		request.object = object;
+		request.frame = frame;
+		request.min[0] = box.minCorner.x;
+		request.min[1] = box.minCorner.y;
+		request.min[2] = box.minCorner.z;
+		request.max[0] = box.maxCorner.x;
+		request.max[1] = box.maxCorner.y;
+		request.max[2] = box.maxCorner.z;
+		requests.push_back(request);
+	}
+	OcclusionQuery::Request *OcclusionQuery::takeRequests(core::MemoryPool *memory,
+	                                                      unsigned int &count)
+	{
+		count = requests.size();
+		if (count == 0)
+			return 0;
+		Request *taken = memory->allocateArray<Request>(count);
+		for (unsigned int i = 0; i < count; i++)
+			taken[i] = requests[i];
+		requests.clear();
+		return taken;
+	}
+
+	void OcclusionQuery::addResult(const Request &request, bool visible)
+	{
+		PendingResult result;
+		result.object = request.object;
+		result.frame = request.frame;
+		result.visible = visible;
+		tbb::spin_mutex::scoped_lock lock(pendingmutex);
+		pending.push_back(result);
+	}
+}
+}
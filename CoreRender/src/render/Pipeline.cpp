@@ -20,6 +20,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include "CoreRender/render/Pipeline.hpp"
+#include "CoreRender/render/SortMode.hpp"
 #include "CoreRender/res/ResourceManager.hpp"
 #include "../3rdparty/tinyxml.h"
 
@@ -435,10 +436,28 @@ namespace render
 					                              getName().c_str());
 					return false;
 				}
+				SortMode::List sortmode = SortMode::State;
+				const char *sortmodestr = element->Attribute("sort");
+				if (sortmodestr)
+				{
+					if (!strcmp(sortmodestr, "State"))
+						sortmode = SortMode::State;
+					else if (!strcmp(sortmodestr, "FrontToBack"))
+						sortmode = SortMode::FrontToBack;
+					else if (!strcmp(sortmodestr, "BackToFront"))
+						sortmode = SortMode::BackToFront;
+					else if (!strcmp(sortmodestr, "None"))
+						sortmode = SortMode::None;
+					else
+						getManager()->getLog()->warning("%s: Unknown sort mode \"%s\".",
+						                                getName().c_str(),
+						                                sortmodestr);
+				}
 				PipelineCommand command;
 				command.type = PipelineCommandType::DrawGeometry;
 				res::NameRegistry &names = getManager()->getNameRegistry();
 				command.uintparams.push_back(names.getContext(context));
+				command.uintparams.push_back(sortmode);
 				stage->commands.push_back(command);
 			}
 			else if (!strcmp(element->Value(), "BindTexture"))
@@ -22,13 +22,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/render/RenderObject.hpp"
 #include "CoreRender/render/UploadManager.hpp"
 
+#include <tbb/atomic.h>
+
 namespace cr
 {
 namespace render
 {
+	static tbb::atomic<unsigned int> nextobjectsortid;
+
 	RenderObject::RenderObject(UploadManager &uploadmgr)
 		: uploadmgr(uploadmgr), uploading(false)
 	{
+		sortid = nextobjectsortid++;
 	}
 	RenderObject::~RenderObject()
 	{
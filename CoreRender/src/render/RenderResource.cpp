@@ -22,15 +22,20 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/render/RenderResource.hpp"
 #include "CoreRender/render/UploadManager.hpp"
 
+#include <tbb/atomic.h>
+
 namespace cr
 {
 namespace render
 {
+	static tbb::atomic<unsigned int> nextresourcesortid;
+
 	RenderResource::RenderResource(UploadManager &uploadmgr,
 	                               res::ResourceManager *rmgr,
 	                               const std::string &name)
 		: Resource(rmgr, name), uploadmgr(uploadmgr), uploading(false)
 	{
+		sortid = nextresourcesortid++;
 	}
 	RenderResource::~RenderResource()
 	{
@@ -129,6 +129,7 @@ namespace render
 	{
 		Uniform uniform;
 		uniform.name = name;
+		uniform.handle = getManager()->getNameRegistry().getUniform(name);
 		uniform.size = ShaderVariableType::getSize(type);
 		memset(uniform.defvalue, 0, 16 * sizeof(float));
 		if (defaultvalue)
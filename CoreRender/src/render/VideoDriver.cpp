@@ -69,6 +69,24 @@ namespace render
 				         command->drawquad.material,
 				         command->drawquad.light);
 				break;
+			case RenderCommandType::DrawQuads:
+				if (command->drawquads.camera)
+					setMatrices(command->drawquads.camera->projmat,
+					            command->drawquads.camera->viewmat,
+					            command->drawquads.camera->viewer);
+				drawQuads(command->drawquads.quads,
+				          command->drawquads.quadcount,
+				          command->drawquads.shader,
+				          command->drawquads.material);
+				break;
+			case RenderCommandType::OcclusionQueries:
+				setMatrices(command->occlusionqueries.camera->projmat,
+				            command->occlusionqueries.camera->viewmat,
+				            command->occlusionqueries.camera->viewer);
+				drawOcclusionQueries(command->occlusionqueries.query,
+				                     command->occlusionqueries.requests,
+				                     command->occlusionqueries.count);
+				break;
 			default:
 				// TODO: Warning here
 				break;
@@ -82,10 +100,13 @@ namespace render
 		            queue->camera->viewmat,
 		            queue->camera->viewer);
 		setLightUniforms(queue->light);
+		// Upload instance data for all batches at once
+		prepareInstances(queue);
 		// Render batches
-		for (unsigned int i = 0; i < queue->batches.size(); i++)
+		unsigned int i = 0;
+		while (i < queue->batchcount)
 		{
-			draw(queue->batches[i]);
+			i += drawMultiple(&queue->batches[i], queue->batchcount - i);
 		}
 	}
 }
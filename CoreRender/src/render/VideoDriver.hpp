@@ -32,6 +32,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/render/RenderStats.hpp"
 #include "CoreRender/render/FrameBuffer.hpp"
 #include "CoreRender/render/Mesh.hpp"
+#include "CoreRender/render/OcclusionQuery.hpp"
 
 namespace cr
 {
@@ -45,7 +46,9 @@ namespace render
 	struct RenderTargetInfo;
 	class UploadManager;
 	struct RenderQueue;
+	struct QuadInstance;
 	struct Batch;
+	struct CustomUniform;
 	class Material;
 	struct TextureBinding;
 	struct LightUniforms;
@@ -65,6 +68,8 @@ namespace render
 			{
 				bindTextures(0, 0);
 				light = 0;
+				// Shaders start with generation 0 which never matches
+				lightgeneration = 1;
 			}
 			/**
 			 * Destructor.
@@ -126,6 +131,10 @@ namespace render
 			 * Creates a new mesh object.
 			 */
 			virtual Mesh::Ptr createMesh(UploadManager &uploadmgr) = 0;
+			/**
+			 * Creates a set of hardware occlusion queries.
+			 */
+			virtual OcclusionQuery::Ptr createOcclusionQuery(UploadManager &uploadmgr) = 0;
 
 			/**
 			 * Sets a render target for following calls to draw() or clear() to
@@ -163,12 +172,32 @@ namespace render
 			 * @param batch Batch to be drawn.
 			 */
 			virtual void draw(Batch *batch) = 0;
+			/**
+			 * Draws a number of consecutive batches. Batches which share
+			 * their state and vertex buffer are merged into a single draw
+			 * call if the driver supports this.
+			 * @param batches Batches to be drawn.
+			 * @param count Number of batches.
+			 * @return Number of batches which were drawn, always at least 1.
+			 */
+			virtual unsigned int drawMultiple(Batch **batches,
+			                                  unsigned int count) = 0;
+			/**
+			 * Prepares the per-instance data of all instanced batches of a
+			 * render queue. This is called once before the batches of the
+			 * queue are drawn so that the data can be uploaded in one go.
+			 * @param queue Render queue which is about to be drawn.
+			 */
+			virtual void prepareInstances(RenderQueue *queue) = 0;
 
 			/**
-			 * Draws a simple quad.
-			 * @param vertices Four vertices, each one consisting of two floats
-			 * for the position in view space (coordinates shall be in the range
-			 * -1..1).
+			 * Draws a simple quad. The shader gets the corner of a unit quad
+			 * (0..1) in the "pos" attrib and the rectangle of the quad in the
+			 * "quadRect" attrib (minimum x/y, maximum x/y) and has to compute
+			 * the actual position itself.
+			 * @param vertices Rectangle of the quad in view space, consisting
+			 * of the minimum and maximum x and y coordinates (coordinates shall
+			 * be in the range -1..1).
 			 * @param shader Shader used for rendering the quad.
 			 * @param material Material settings used for the quad.
 			 * @param light Current light setting. 0 If no light is active.
@@ -177,6 +206,35 @@ namespace render
 			                      ShaderCombination *shader,
 			                      Material *material,
 			                      LightUniforms *light) = 0;
+			/**
+			 * Draws a number of quads with a single instanced draw call. The
+			 * shader gets the same attribs as with drawQuad(), except that
+			 * the light parameters are passed in the "lightPos", "lightColor"
+			 * and "lightDir" attribs instead of uniforms. Shadow maps are not
+			 * supported.
+			 * @param quads Rectangles and lights of the quads.
+			 * @param count Number of quads.
+			 * @param shader Instanced shader used for rendering the quads.
+			 * @param material Material settings used for the quads.
+			 */
+			virtual void drawQuads(QuadInstance *quads,
+			                       unsigned int count,
+			                       ShaderCombination *shader,
+			                       Material *material) = 0;
+			/**
+			 * Draws the bounding boxes of a number of objects without
+			 * changing the color or depth buffer and issues an occlusion
+			 * query for every box. Results of earlier queries which have
+			 * become available are passed to OcclusionQuery::addResult().
+			 * If occlusion queries are not supported, nothing is done and all
+			 * objects stay visible.
+			 * @param query Query object the requests belong to.
+			 * @param requests Bounding boxes to be queried.
+			 * @param count Number of requests.
+			 */
+			virtual void drawOcclusionQueries(OcclusionQuery *query,
+			                                  OcclusionQuery::Request *requests,
+			                                  unsigned int count) = 0;
 
 			/**
 			 * Called at the beginning of a frame. This initializes the needed
@@ -210,12 +268,25 @@ namespace render
 
 			void setLightUniforms(LightUniforms *light)
 			{
-				this->light = light;
+				if (light != this->light)
+				{
+					this->light = light;
+					lightgeneration++;
+				}
 			}
 			LightUniforms *getLightUniforms()
 			{
 				return light;
 			}
+			/**
+			 * Returns a number which is incremented every time the light
+			 * uniforms change, so that the driver can compare it against the
+			 * value at the last upload to only upload the uniforms if needed.
+			 */
+			unsigned int getLightGeneration()
+			{
+				return lightgeneration;
+			}
 
 			/**
 			 * Returns the type of this video driver.
@@ -258,6 +329,7 @@ namespace render
 			unsigned int texturecount;
 
 			LightUniforms *light;
+			unsigned int lightgeneration;
 	};
 }
 }
@@ -30,16 +30,14 @@ namespace render
 namespace opengl
 {
 	MeshOpenGL::MeshOpenGL(UploadManager &uploadmgr, bool usevaobjects)
-		: Mesh(uploadmgr), uploaded(0), usevaobjects(usevaobjects), handle(0),
-		dirty(false)
+		: Mesh(uploadmgr), uploaded(0), usevaobjects(usevaobjects)
 	{
 	}
 	MeshOpenGL::~MeshOpenGL()
 	{
 		if (uploaded)
 			delete uploaded;
-		if (handle != 0)
-			glDeleteVertexArrays(1, &handle);
+		deleteVertexArrays();
 	}
 
 	void MeshOpenGL::upload(void *data)
@@ -47,23 +45,37 @@ namespace opengl
 		if (uploaded)
 			delete uploaded;
 		uploaded = (MeshData*)data;
-		dirty = true;
-		// Created vertex array object if necessary
-		if (usevaobjects)
+		// The buffers or offsets might have changed, so all vertex array
+		// objects have to be recreated
+		deleteVertexArrays();
+	}
+
+	unsigned int MeshOpenGL::getVertexArray(unsigned int attribset, bool &setup)
+	{
+		unsigned int changecounter = uploaded->layout->getChangeCounter();
+		for (unsigned int i = 0; i < vertexarrays.size(); i++)
 		{
-			if (handle == 0)
-			{
-				glGenVertexArrays(1, &handle);
-			}
+			if (vertexarrays[i].attribset != attribset)
+				continue;
+			setup = vertexarrays[i].layoutchangecounter != changecounter;
+			vertexarrays[i].layoutchangecounter = changecounter;
+			return vertexarrays[i].handle;
 		}
+		// Create a new vertex array object for this attrib set
+		VertexArray vertexarray;
+		vertexarray.attribset = attribset;
+		vertexarray.layoutchangecounter = changecounter;
+		glGenVertexArrays(1, &vertexarray.handle);
+		vertexarrays.push_back(vertexarray);
+		setup = true;
+		return vertexarray.handle;
 	}
 
-	void MeshOpenGL::update()
+	void MeshOpenGL::deleteVertexArrays()
 	{
-		dirty = false;
-		// TODO: This is not that easy as we have to user-defined attrib
-		// locations in the shader?
-		// Probably the layout needs to be a shader property
+		for (unsigned int i = 0; i < vertexarrays.size(); i++)
+			glDeleteVertexArrays(1, &vertexarrays[i].handle);
+		vertexarrays.clear();
 	}
 }
 }
@@ -24,6 +24,8 @@
 
 #include "CoreRender/render/Mesh.hpp"
 
+#include <vector>
+
 namespace cr
 {
 namespace render
@@ -42,20 +44,34 @@ namespace opengl
 			{
 				return uploaded;
 			}
-			bool isDirty()
-			{
-				return dirty;
-			}
-			unsigned int getHandle()
+			bool usesVertexArrays()
 			{
-				return handle;
+				return usevaobjects;
 			}
-			void update();
+			/**
+			 * Returns the vertex array object for the attrib set of a shader,
+			 * creating it if necessary.
+			 * @param attribset Attrib set, see ShaderCombination::attribset.
+			 * @param setup Is set to true if the vertex array object has to be
+			 * filled with the vertex attribs and the index buffer, either
+			 * because it was just created or because the vertex layout of the
+			 * mesh was changed.
+			 * @return Vertex array object handle.
+			 */
+			unsigned int getVertexArray(unsigned int attribset, bool &setup);
 		private:
+			void deleteVertexArrays();
+
 			MeshData *uploaded;
 			bool usevaobjects;
-			unsigned int handle;
-			bool dirty;
+
+			struct VertexArray
+			{
+				unsigned int attribset;
+				unsigned int layoutchangecounter;
+				unsigned int handle;
+			};
+			std::vector<VertexArray> vertexarrays;
 	};
 }
 }
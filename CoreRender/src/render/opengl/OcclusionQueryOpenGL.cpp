@@ -0,0 +1,90 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "OcclusionQueryOpenGL.hpp"
+
+#include <GL/glew.h>
+
+namespace cr
+{
+namespace render
+{
+namespace opengl
+{
+	OcclusionQueryOpenGL::OcclusionQueryOpenGL(UploadManager &uploadmgr)
+		: OcclusionQuery(uploadmgr)
+	{
+	}
+	OcclusionQueryOpenGL::~OcclusionQueryOpenGL()
+	{
+		// The object is deleted by the render thread, so the context is
+		// current here
+		for (unsigned int i = 0; i < pendingqueries.size(); i++)
+			glDeleteQueries(1, &pendingqueries[i].handle);
+		if (!freequeries.empty())
+			glDeleteQueries(freequeries.size(), &freequeries[0]);
+	}
+
+	unsigned int OcclusionQueryOpenGL::allocateQuery()
+	{
+		if (!freequeries.empty())
+		{
+			unsigned int handle = freequeries.back();
+			freequeries.pop_back();
+			return handle;
+		}
+		unsigned int handle;
+		glGenQueries(1, &handle);
+		return handle;
+	}
+	void OcclusionQueryOpenGL::addPending(const Request &request,
+	                                      unsigned int handle)
+	{
+		PendingQuery query;
+		query.request = request;
+		query.handle = handle;
+		pendingqueries.push_back(query);
+	}
+
+	unsigned int OcclusionQueryOpenGL::collectResults()
+	{
+		unsigned int collected = 0;
+		while (!pendingqueries.empty())
+		{
+			PendingQuery &query = pendingqueries.front();
+			unsigned int available = GL_FALSE;
+			glGetQueryObjectuiv(query.handle,
+			                    GL_QUERY_RESULT_AVAILABLE,
+			                    &available);
+			if (available == GL_FALSE)
+				break;
+			unsigned int samples = 0;
+			glGetQueryObjectuiv(query.handle, GL_QUERY_RESULT, &samples);
+			addResult(query.request, samples != 0);
+			freequeries.push_back(query.handle);
+			pendingqueries.pop_front();
+			collected++;
+		}
+		return collected;
+	}
+}
+}
+}
@@ -0,0 +1,74 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _CORERENDER_RENDER_OPENGL_OCCLUSIONQUERYOPENGL_HPP_INCLUDED_
+#define _CORERENDER_RENDER_OPENGL_OCCLUSIONQUERYOPENGL_HPP_INCLUDED_
+
+#include "CoreRender/render/OcclusionQuery.hpp"
+
+#include <deque>
+#include <vector>
+
+namespace cr
+{
+namespace render
+{
+namespace opengl
+{
+	class OcclusionQueryOpenGL : public OcclusionQuery
+	{
+		public:
+			OcclusionQueryOpenGL(UploadManager &uploadmgr);
+			~OcclusionQueryOpenGL();
+
+			/**
+			 * Returns an unused query object, creating it if necessary.
+			 */
+			unsigned int allocateQuery();
+			/**
+			 * Registers a query object which was issued for a request.
+			 */
+			void addPending(const Request &request, unsigned int handle);
+			/**
+			 * Reads back all available query results without waiting for the
+			 * GPU and passes them to addResult().
+			 * @return Number of results which were read back.
+			 */
+			unsigned int collectResults();
+		private:
+			struct PendingQuery
+			{
+				Request request;
+				unsigned int handle;
+			};
+			/**
+			 * Queries in the order in which they were issued. The GPU
+			 * finishes queries in order, so collecting stops at the first
+			 * query without a result.
+			 */
+			std::deque<PendingQuery> pendingqueries;
+			std::vector<unsigned int> freequeries;
+	};
+}
+}
+}
+
+#endif
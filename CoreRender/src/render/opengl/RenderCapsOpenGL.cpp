@@ -76,6 +76,16 @@ namespace opengl
 		{
 			flags |= 1 << Flag::TextureRG;
 		}
+		if (GLEW_ARB_vertex_array_object || GLEW_VERSION_3_0)
+		{
+			flags |= 1 << Flag::VertexArrayObject;
+		}
+		// glMultiDrawElements() is part of OpenGL 1.4
+		flags |= 1 << Flag::MultiDraw;
+		if (GLEW_ARB_draw_elements_base_vertex || GLEW_VERSION_3_2)
+		{
+			flags |= 1 << Flag::DrawBaseVertex;
+		}
 		if (GLEW_ARB_geometry_shader4)
 		{
 			flags |= 1 << Flag::GeometryShader;
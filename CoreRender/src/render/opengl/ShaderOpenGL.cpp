@@ -23,6 +23,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/res/ResourceManager.hpp"
 
 #include <GL/glew.h>
+#include <tbb/mutex.h>
 #include <sstream>
 
 namespace cr
@@ -31,6 +32,27 @@ namespace render
 {
 namespace opengl
 {
+	static tbb::mutex attribsetmutex;
+	/**
+	 * Attrib names and locations of all distinct attrib sets.
+	 */
+	static std::vector<std::vector<int> > attribsets;
+
+	/**
+	 * Returns the ID of an attrib set, starting at 1.
+	 */
+	static unsigned int getAttribSet(const std::vector<int> &attribs)
+	{
+		tbb::mutex::scoped_lock lock(attribsetmutex);
+		for (unsigned int i = 0; i < attribsets.size(); i++)
+		{
+			if (attribsets[i] == attribs)
+				return i + 1;
+		}
+		attribsets.push_back(attribs);
+		return attribsets.size();
+	}
+
 	ShaderOpenGL::ShaderOpenGL(UploadManager &uploadmgr,
 	                           res::ResourceManager *rmgr,
 	                           const std::string &name)
@@ -175,13 +197,31 @@ namespace opengl
 			int location = glGetAttribLocation(program, attribname.c_str());
 			combination->attriblocations[i] = location;
 		}
+		std::vector<int> attribset;
+		for (unsigned int i = 0; i < uploadedinfo.attribs.size(); i++)
+		{
+			if (combination->attriblocations[i] == -1)
+				continue;
+			attribset.push_back(uploadedinfo.attribs[i]);
+			attribset.push_back(combination->attriblocations[i]);
+		}
+		combination->attribset = getAttribSet(attribset);
 		// Skinning transMat attrib
 		combination->transmatattrib = glGetAttribLocation(program, "transMat");
+		// Quad attribs
+		combination->quadrectattrib = glGetAttribLocation(program, "quadRect");
+		combination->lightposattrib = glGetAttribLocation(program, "lightPos");
+		combination->lightcolorattrib = glGetAttribLocation(program, "lightColor");
+		combination->lightdirattrib = glGetAttribLocation(program, "lightDir");
 		// Get default uniform locations
 		combination->uniforms.worldmat = glGetUniformLocation(program,
 		                                                      "worldMat");
 		combination->uniforms.worldnormalmat = glGetUniformLocation(program,
 		                                                            "worldNormalMat");
+		if (combination->uniforms.worldnormalmat == -1)
+			combination->normalmatrix = NormalMatrixUsage::Unused;
+		else
+			combination->normalmatrix = NormalMatrixUsage::Used;
 		combination->uniforms.viewmat = glGetUniformLocation(program,
 		                                                     "viewMat");
 		combination->uniforms.viewmatinv = glGetUniformLocation(program,
@@ -212,12 +252,26 @@ namespace opengl
 		                                                       "shadowMap");
 		// Get uniform locations
 		combination->customuniforms.resize(uploadedinfo.uniforms.size());
+		combination->customuniformindices.clear();
 		for (unsigned int i = 0; i < uploadedinfo.uniforms.size(); i++)
 		{
 			const std::string &name = uploadedinfo.uniforms[i].name;
 			combination->customuniforms[i] = glGetUniformLocation(program,
 			                                                      name.c_str());
+			// Map the uniform handle to the uniform
+			unsigned int handle = uploadedinfo.uniforms[i].handle;
+			if (handle >= combination->customuniformindices.size())
+				combination->customuniformindices.resize(handle + 1, -1);
+			combination->customuniformindices[handle] = i;
 		}
+		// The new program does not contain any uniform values yet
+		combination->camerageneration = 0;
+		combination->lightgeneration = 0;
+		combination->customuniformcache.clear();
+		combination->customuniformcache.resize(uploadedinfo.uniforms.size() * 16);
+		combination->customuniformcachesize.clear();
+		combination->customuniformcachesize.resize(uploadedinfo.uniforms.size(), 0);
+		combination->samplerunitsset = false;
 		// Get sampler locations
 		combination->samplerlocations.resize(uploadedinfo.samplers.size());
 		for (unsigned int i = 0; i < uploadedinfo.samplers.size(); i++)
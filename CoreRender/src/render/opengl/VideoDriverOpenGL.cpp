@@ -26,6 +26,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "ShaderOpenGL.hpp"
 #include "FrameBufferOpenGL.hpp"
 #include "MeshOpenGL.hpp"
+#include "OcclusionQueryOpenGL.hpp"
 #include "CoreRender/render/FrameData.hpp"
 #include "CoreRender/render/VertexLayout.hpp"
 #include "CoreRender/render/Material.hpp"
@@ -34,6 +35,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/render/Image.hpp"
 
 #include <GL/glew.h>
+#include <cstring>
 
 namespace cr
 {
@@ -42,11 +44,19 @@ namespace render
 namespace opengl
 {
 	VideoDriverOpenGL::VideoDriverOpenGL(core::Log::Ptr log)
-		: log(log), currentfb(0), currentshader(0), currentvertices(0),
-		currentindices(0), currentblendmode(BlendMode::Replace),
+		: log(log), currentfb(0), currentshader(0), currentuniforms(0),
+		currentvertices(0), currentindices(0), currentvertexarray(0),
+		currentblendmode(BlendMode::Replace),
 		currentdepthwrite(true), currentdepthtest(DepthTest::Less),
-		currentdrawbuffers(1)
+		currentdrawbuffers(1), camerageneration(1), instancebuffer(0),
+		instancebuffersize(0), instancebufferoffset(0), instancereadoffset(0),
+		instancereadend(0), mapbufferrange(false), quadvertexbuffer(0),
+		quadindexbuffer(0), boxvertexbuffer(0), boxindexbuffer(0),
+		boxprogram(0), boxminuniform(-1), boxsizeuniform(-1),
+		boxviewprojuniform(-1), boxposattrib(-1), activetextureunit(0)
 	{
+		memset(viewport, 0, sizeof(viewport));
+		memset(textureunits, 0, sizeof(textureunits));
 	}
 	VideoDriverOpenGL::~VideoDriverOpenGL()
 	{
@@ -75,14 +85,68 @@ namespace opengl
 			log->error("Could not initialize capabilities.");
 			return false;
 		}
-		// Initialize instancing transMat buffer object
-		// TODO: This is a hack, but using plain vertex arrays hits a slow path
-		// at least here
-		glGenBuffers(1, &instancingbuffer);
+		// Initialize the streaming buffer for instancing data
+		mapbufferrange = GLEW_ARB_map_buffer_range || GLEW_VERSION_3_0;
+		glGenBuffers(1, &instancebuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+		glBufferData(GL_ARRAY_BUFFER, INSTANCE_BUFFER_SIZE, 0, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		instancebuffersize = INSTANCE_BUFFER_SIZE;
+		instancebufferoffset = 0;
+		// Initialize the unit quad used by drawQuad()
+		float quadvertices[8] = {
+			0.0f, 0.0f,
+			1.0f, 0.0f,
+			0.0f, 1.0f,
+			1.0f, 1.0f
+		};
+		unsigned char quadindices[6] = {
+			0, 1, 2,
+			2, 1, 3
+		};
+		glGenBuffers(1, &quadvertexbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, quadvertexbuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(quadvertices), quadvertices,
+			GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glGenBuffers(1, &quadindexbuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadindexbuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadindices), quadindices,
+			GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		// Initialize the unit cube used for occlusion queries, without it
+		// all objects are treated as visible
+		if (caps.getFlag(RenderCaps::Flag::OcclusionQuery)
+		 && !createBoxShader())
+			log->warning("Could not create the occlusion query shader.");
 		return true;
 	}
 	bool VideoDriverOpenGL::shutdown()
 	{
+		if (quadvertexbuffer)
+		{
+			glDeleteBuffers(1, &quadvertexbuffer);
+			glDeleteBuffers(1, &quadindexbuffer);
+			quadvertexbuffer = 0;
+			quadindexbuffer = 0;
+		}
+		if (instancebuffer)
+		{
+			glDeleteBuffers(1, &instancebuffer);
+			instancebuffer = 0;
+		}
+		if (boxvertexbuffer)
+		{
+			glDeleteBuffers(1, &boxvertexbuffer);
+			glDeleteBuffers(1, &boxindexbuffer);
+			boxvertexbuffer = 0;
+			boxindexbuffer = 0;
+		}
+		if (boxprogram)
+		{
+			glDeleteProgram(boxprogram);
+			boxprogram = 0;
+		}
 		return true;
 	}
 
@@ -118,8 +182,12 @@ namespace opengl
 	}
 	Mesh::Ptr VideoDriverOpenGL::createMesh(UploadManager &uploadmgr)
 	{
-		// TODO: Conditionally enable vertex array objects
-		return new MeshOpenGL(uploadmgr, false);
+		bool usevaobjects = caps.getFlag(RenderCaps::Flag::VertexArrayObject);
+		return new MeshOpenGL(uploadmgr, usevaobjects);
+	}
+	OcclusionQuery::Ptr VideoDriverOpenGL::createOcclusionQuery(UploadManager &uploadmgr)
+	{
+		return new OcclusionQueryOpenGL(uploadmgr);
 	}
 
 	void VideoDriverOpenGL::setRenderTarget(const RenderTargetInfo *target)
@@ -227,6 +295,8 @@ namespace opengl
 		glViewport(x, y, width, height);
 		viewport[0] = x;
 		viewport[1] = y;
+		if (viewport[2] != width || viewport[3] != height)
+			camerageneration++;
 		viewport[2] = width;
 		viewport[3] = height;
 	}
@@ -266,8 +336,60 @@ namespace opengl
 
 	void VideoDriverOpenGL::draw(Batch *batch)
 	{
-		if (batch->shader->programobject == 0)
+		bool usevertexarray;
+		if (!applyBatchState(batch, usevertexarray))
 			return;
+		// Draw geometry
+		if (batch->transmatcount == 0)
+			drawSingle(batch, batch->transmat, batch->normalmat);
+		else
+		{
+			if (batch->shader->instancing)
+				drawInstanced(batch, batch->transmatcount, batch->transmatlist);
+			else
+			{
+				for (unsigned int i = 0; i < batch->transmatcount; i++)
+				{
+					math::Mat4f *normalmat = 0;
+					if (batch->normalmat)
+						normalmat = &batch->normalmat[i];
+					drawSingle(batch, batch->transmatlist[i], normalmat);
+				}
+			}
+		}
+		cleanupAttribs(batch, usevertexarray);
+	}
+	unsigned int VideoDriverOpenGL::drawMultiple(Batch **batches,
+	                                             unsigned int count)
+	{
+		// Collect the following batches which only differ in the part of the
+		// vertex/index buffer they use
+		Batch *batch = batches[0];
+		unsigned int mergecount = 1;
+		if (caps.getFlag(RenderCaps::Flag::MultiDraw))
+		{
+			while (mergecount < count
+			       && canDrawMerged(batch, batches[mergecount]))
+				mergecount++;
+		}
+		if (mergecount == 1)
+		{
+			draw(batch);
+			return 1;
+		}
+		// All merged batches use the state of the first one
+		bool usevertexarray;
+		if (!applyBatchState(batch, usevertexarray))
+			return mergecount;
+		drawMerged(batches, mergecount);
+		cleanupAttribs(batch, usevertexarray);
+		return mergecount;
+	}
+
+	bool VideoDriverOpenGL::applyBatchState(Batch *batch, bool &usevertexarray)
+	{
+		if (batch->shader->programobject == 0)
+			return false;
 		if (batch->scissor)
 		{
 			glScissor(batch->scissor->x,
@@ -286,194 +408,73 @@ namespace opengl
 		setDepthTest(batch->shader->uploadeddata.depthtest);
 		// Change depth write
 		setDepthWrite(batch->shader->uploadeddata.depthwrite);
-		// Change vertex/index buffer
+		// Change vertex buffer
 		Mesh::MeshData *mesh = ((MeshOpenGL*)batch->mesh)->getData();
 		setVertexBuffer(mesh->vertices);
-		if (mesh->indices)
-			setIndexBuffer(mesh->indices);
 		// Bind shader
 		// TODO: Error checking
-		if (currentshader != batch->shader)
+		bool shaderchanged = currentshader != batch->shader;
+		if (shaderchanged)
 		{
 			glUseProgram(batch->shader->programobject);
 			currentshader = batch->shader;
 		}
 		Shader::ShaderInfo *shaderinfo = batch->shader->shader->getUploadedData();
 		// Apply attribs
-		for (unsigned int i = 0; i < shaderinfo->attribs.size(); i++)
+		MeshOpenGL *meshgl = (MeshOpenGL*)batch->mesh;
+		usevertexarray = meshgl->usesVertexArrays();
+		if (usevertexarray)
 		{
-			int attribhandle = batch->shader->attriblocations[i];
-			if (attribhandle == -1)
-				continue;
-			unsigned int name = shaderinfo->attribs[i];
-			VertexLayoutElement *layoutelem = mesh->layout->getElementByName(name);
-			if (!layoutelem)
-				continue;
-			unsigned int opengltype = GL_FLOAT;
-			int normalize = layoutelem->normalize ? GL_TRUE : GL_FALSE;
-			switch (layoutelem->type)
+			// The vertex array object contains all attribs and the index
+			// buffer, so usually we only have to bind it
+			bool setup;
+			unsigned int vertexarray;
+			vertexarray = meshgl->getVertexArray(batch->shader->attribset, setup);
+			setVertexArray(vertexarray);
+			if (setup)
 			{
-				case VertexElementType::Float:
-					opengltype = GL_FLOAT;
-					break;
-				case VertexElementType::DoubleFloat:
-					opengltype = GL_DOUBLE;
-					break;
-				case VertexElementType::HalfFloat:
-					// TODO
-					opengltype = GL_FLOAT;
-					break;
-				case VertexElementType::Integer:
-					opengltype = GL_INT;
-					break;
-				case VertexElementType::Short:
-					opengltype = GL_SHORT;
-					break;
-				case VertexElementType::Byte:
-					opengltype = GL_BYTE;
-					break;
-				case VertexElementType::UnsignedInteger:
-					opengltype = GL_UNSIGNED_INT;
-					break;
-				case VertexElementType::UnsignedShort:
-					opengltype = GL_UNSIGNED_SHORT;
-					break;
-				case VertexElementType::UnsignedByte:
-					opengltype = GL_UNSIGNED_BYTE;
-					break;
+				if (mesh->indices)
+					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indices->getHandle());
+				else
+					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+				applyAttribs(batch, shaderinfo, mesh);
 			}
-			glEnableVertexAttribArray(attribhandle);
-			glVertexAttribPointer(attribhandle,
-			                      layoutelem->components,
-			                      opengltype,
-			                      normalize,
-			                      layoutelem->stride,
-			                      (void*)(layoutelem->offset + mesh->vertexoffset));
 		}
-		// Custom uniforms
-		for (unsigned int i = 0; i < shaderinfo->uniforms.size(); i++)
+		else
 		{
-			// Get uniform shader handle
-			int uniformhandle = batch->shader->customuniforms[i];
-			if (uniformhandle == -1)
-				continue;
-			// Get uniform data
-			unsigned int size = 0;
-			float *data = 0;
-			for (unsigned int j = 0; j < batch->customuniformcount; j++)
-			{
-				if (shaderinfo->uniforms[i].name == batch->customuniforms[j].name)
-				{
-					size = batch->customuniforms[j].size;
-					data = batch->customuniforms[j].data;
-					break;
-				}
-			}
-			if (!data)
-			{
-				size = shaderinfo->uniforms[i].size;
-				data = shaderinfo->uniforms[i].defvalue;
-			}
-			// Disallow uploading of more than 4x4 matrices
-			if (size > 16)
-				size = 16;
-			// Upload uniform value
-			// TODO: Integer uniforms?
-			switch (size)
-			{
-				case 1:
-					glUniform1f(uniformhandle, data[0]);
-					break;
-				case 2:
-					glUniform2f(uniformhandle, data[0], data[1]);
-					break;
-				case 3:
-					glUniform3f(uniformhandle, data[0], data[1], data[2]);
-					break;
-				case 4:
-					glUniform4f(uniformhandle, data[0], data[1], data[2], data[3]);
-					break;
-				case 9:
-					glUniformMatrix3fv(uniformhandle, 1, GL_FALSE, data);
-					break;
-				case 12:
-					glUniformMatrix4x3fv(uniformhandle, 1, GL_FALSE, data);
-					break;
-				case 16:
-					glUniformMatrix4fv(uniformhandle, 1, GL_FALSE, data);
-					break;
-			}
+			setVertexArray(0);
+			if (mesh->indices)
+				setIndexBuffer(mesh->indices);
+			applyAttribs(batch, shaderinfo, mesh);
+		}
+		// Custom uniforms - consecutive batches of the same material share
+		// their uniforms, so the values only have to be uploaded once
+		if (shaderchanged || batch->customuniforms != currentuniforms)
+		{
+			applyCustomUniforms(batch, shaderinfo);
+			currentuniforms = batch->customuniforms;
 		}
 		// Apply textures
 		applyTextures(batch->shader, batch->material);
 		// Default uniforms (not dependant on the transformation matrix)
+		applyCameraUniforms(batch->shader);
+		UniformLocations &locations = batch->shader->uniforms;
+		if (batch->shader->skinning && locations.skinmat != -1)
 		{
-			UniformLocations &locations = batch->shader->uniforms;
-			if (locations.projmat != -1)
-				glUniformMatrix4fv(locations.projmat, 1, GL_FALSE, projmat.m);
-			if (locations.viewmat != -1)
-				glUniformMatrix4fv(locations.viewmat, 1, GL_FALSE, viewmat.m);
-			if (locations.viewmatinv != -1)
-				glUniformMatrix4fv(locations.viewmatinv, 1, GL_FALSE, viewmatinv.m);
-			if (locations.viewprojmat != -1)
-				glUniformMatrix4fv(locations.viewprojmat, 1, GL_FALSE, viewprojmat.m);
-			if (locations.viewerpos != -1)
-				glUniform3f(locations.viewerpos, viewer.x, viewer.y, viewer.z);
-			if (batch->shader->skinning && locations.skinmat != -1)
-				glUniformMatrix4fv(locations.skinmat,
-				                   batch->skinmatcount,
-				                   GL_FALSE,
-				                   batch->skinmat);
-			if (locations.framebufsize != -1)
-				glUniform2f(locations.framebufsize, viewport[2], viewport[3]);
-			// TODO: Other uniforms
-			LightUniforms *light = getLightUniforms();
-			if (light)
-			{
-				if (locations.lightpos != -1)
-					glUniform4f(locations.lightpos,
-					            light->position[0],
-					            light->position[1],
-					            light->position[2],
-					            light->position[3]);
-				if (locations.lightdir != -1)
-					glUniform3f(locations.lightdir,
-					            light->direction[0],
-					            light->direction[1],
-					            light->direction[2]);
-				if (locations.lightcolor != -1)
-					glUniform4f(locations.lightcolor,
-					            light->color[0],
-					            light->color[1],
-					            light->color[2],
-					            light->color[3]);
-				if (locations.shadowmat != -1)
-					glUniformMatrix4fv(locations.shadowmat, 1, GL_FALSE, light->shadowmat.m);
-				if (locations.shadowmap && light->shadowmap)
-				{
-					unsigned int texcount = shaderinfo->samplers.size();
-					glActiveTexture(GL_TEXTURE0 + texcount);
-					glBindTexture(GL_TEXTURE_2D, light->shadowmap->getHandle());
-					glUniform1i(locations.shadowmap, texcount);
-				}
-			}
+			glUniformMatrix4fv(locations.skinmat,
+			                   batch->skinmatcount,
+			                   GL_FALSE,
+			                   batch->skinmat);
+			getStats().increaseUniformCallCount(1);
 		}
-		// Draw geometry
-		if (batch->transmatcount == 0)
-			drawSingle(batch, batch->transmat);
-		else
-		{
-			if (batch->shader->instancing)
-				drawInstanced(batch, batch->transmatcount, batch->transmatlist);
-			else
-			{
-				for (unsigned int i = 0; i < batch->transmatcount; i++)
-				{
-					drawSingle(batch, batch->transmatlist[i]);
-				}
-			}
-		}
-		// Clean up attribs
+		applyLightUniforms(batch->shader);
+		return true;
+	}
+	void VideoDriverOpenGL::cleanupAttribs(Batch *batch, bool usevertexarray)
+	{
+		// Vertex array objects keep their attribs
+		if (usevertexarray)
+			return;
 		for (unsigned int i = 0; i < batch->shader->attriblocations.size(); i++)
 		{
 			if (batch->shader->attriblocations[i] == -1)
@@ -487,18 +488,97 @@ namespace opengl
 	                                 Material *material,
 	                                 LightUniforms *light)
 	{
-		if (shader->programobject == 0)
+		if (!applyQuadState(shader, material))
+			return;
+		// Uniforms
+		setLightUniforms(light);
+		applyLightUniforms(shader);
+		// The rectangle is passed as a constant attrib
+		if (shader->quadrectattrib != -1)
+		{
+			glVertexAttrib4f(shader->quadrectattrib,
+			                 vertices[0],
+			                 vertices[1],
+			                 vertices[2],
+			                 vertices[3]);
+		}
+		// Draw a single quad
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);
+		cleanupQuadState(shader);
+	}
+	void VideoDriverOpenGL::drawQuads(QuadInstance *quads,
+	                                  unsigned int count,
+	                                  ShaderCombination *shader,
+	                                  Material *material)
+	{
+		if (shader->programobject == 0 || count == 0)
+			return;
+		// Upload rectangle and light parameters of all quads
+		unsigned int size = count * QUAD_INSTANCE_SIZE;
+		unsigned int offset;
+		float *data = mapInstanceBuffer(size, offset);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			LightUniforms *light = quads[i].light;
+			memcpy(&data[0], quads[i].quad, 4 * sizeof(float));
+			memcpy(&data[4], light->position, 4 * sizeof(float));
+			memcpy(&data[8], light->color, 4 * sizeof(float));
+			memcpy(&data[12], light->direction, 3 * sizeof(float));
+			data[15] = 0.0f;
+			data += 16;
+		}
+		unmapInstanceBuffer(offset, size);
+		if (!applyQuadState(shader, material))
 			return;
+		// The light uniforms are not used by the shader
+		setLightUniforms(0);
+		// Set per-instance attribs
+		int attribs[4] = {
+			shader->quadrectattrib,
+			shader->lightposattrib,
+			shader->lightcolorattrib,
+			shader->lightdirattrib
+		};
+		glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			if (attribs[i] == -1)
+				continue;
+			glEnableVertexAttribArray(attribs[i]);
+			glVertexAttribPointer(attribs[i], 4, GL_FLOAT, GL_FALSE,
+				QUAD_INSTANCE_SIZE,
+				(char*)0 + offset + i * 4 * sizeof(float));
+			glVertexAttribDivisorARB(attribs[i], 1);
+		}
+		// Draw all quads
+		glDrawElementsInstancedARB(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0, count);
+		// Clean up attribs
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			if (attribs[i] == -1)
+				continue;
+			glVertexAttribDivisorARB(attribs[i], 0);
+			glDisableVertexAttribArray(attribs[i]);
+		}
+		cleanupQuadState(shader);
+	}
+	bool VideoDriverOpenGL::applyQuadState(ShaderCombination *shader,
+	                                       Material *material)
+	{
+		if (shader->programobject == 0)
+			return false;
 		// Change blend mode if necessary
 		setBlendMode(shader->uploadeddata.blendmode);
 		// Change depth test
 		setDepthTest(shader->uploadeddata.depthtest);
 		// Change depth write
 		setDepthWrite(shader->uploadeddata.depthwrite);
-		// Disable vertex/index buffers, we directly read the vertices from the
-		// passed buffer
+		// The quad is drawn from the static unit quad buffers
+		setVertexArray(0);
 		setVertexBuffer(0);
 		setIndexBuffer(0);
+		glBindBuffer(GL_ARRAY_BUFFER, quadvertexbuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadindexbuffer);
 		// Bind shader
 		// TODO: Error checking
 		if (currentshader != shader)
@@ -509,15 +589,6 @@ namespace opengl
 		Shader::ShaderInfo *shaderinfo = shader->shader->getUploadedData();
 		// Apply attribs
 		// We only bind the hardcoded pos attribute here
-		float vertexdata[8];
-		vertexdata[0] = vertices[0];
-		vertexdata[1] = vertices[1];
-		vertexdata[2] = vertices[2];
-		vertexdata[3] = vertices[1];
-		vertexdata[4] = vertices[0];
-		vertexdata[5] = vertices[3];
-		vertexdata[6] = vertices[2];
-		vertexdata[7] = vertices[3];
 		unsigned int posattribname = material->getManager()->getNameRegistry().getAttrib("pos");
 		for (unsigned int i = 0; i < shaderinfo->attribs.size(); i++)
 		{
@@ -528,75 +599,162 @@ namespace opengl
 			if (name != posattribname)
 				continue;
 			glEnableVertexAttribArray(attribhandle);
-			glVertexAttribPointer(attribhandle, 2, GL_FLOAT, GL_FALSE, 0, vertexdata);
+			glVertexAttribPointer(attribhandle, 2, GL_FLOAT, GL_FALSE, 0, 0);
 		}
 		// Apply textures
 		applyTextures(shader, material);
 		// Uniforms
-		// TODO
-		UniformLocations &locations = shader->uniforms;
-		if (locations.framebufsize != -1)
-			glUniform2f(locations.framebufsize, viewport[2], viewport[3]);
-		if (locations.projmat != -1)
-			glUniformMatrix4fv(locations.projmat, 1, GL_FALSE, projmat.m);
-		if (locations.viewmat != -1)
-			glUniformMatrix4fv(locations.viewmat, 1, GL_FALSE, viewmat.m);
-		if (locations.viewmatinv != -1)
-			glUniformMatrix4fv(locations.viewmatinv, 1, GL_FALSE, viewmatinv.m);
-		if (locations.viewprojmat != -1)
-			glUniformMatrix4fv(locations.viewprojmat, 1, GL_FALSE, viewprojmat.m);
-		if (locations.viewerpos != -1)
-			glUniform3f(locations.viewerpos, viewer.x, viewer.y, viewer.z);
-		if (light)
-		{
-			if (locations.lightpos != -1)
-				glUniform4f(locations.lightpos,
-				            light->position[0],
-				            light->position[1],
-				            light->position[2],
-				            light->position[3]);
-			if (locations.lightdir != -1)
-				glUniform3f(locations.lightdir,
-				            light->direction[0],
-				            light->direction[1],
-				            light->direction[2]);
-			if (locations.lightcolor != -1)
-				glUniform4f(locations.lightcolor,
-				            light->color[0],
-				            light->color[1],
-				            light->color[2],
-				            light->color[3]);
-			if (locations.shadowmat != -1)
-				glUniformMatrix4fv(locations.shadowmat, 1, GL_FALSE, light->shadowmat.m);
-			if (locations.shadowmap && light->shadowmap)
-			{
-				unsigned int texcount = shaderinfo->samplers.size();
-				glActiveTexture(GL_TEXTURE0 + texcount);
-				glBindTexture(GL_TEXTURE_2D, light->shadowmap->getHandle());
-				glUniform1i(locations.shadowmap, texcount);
-			}
-		}
-		// Draw a single quad
-		unsigned char indices[] = {
-			0, 1, 2,
-			2, 1, 3
-		};
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
+		applyCameraUniforms(shader);
+		return true;
+	}
+	void VideoDriverOpenGL::cleanupQuadState(ShaderCombination *shader)
+	{
 		// Clean up attribs
 		for (unsigned int i = 0; i < shader->attriblocations.size(); i++)
 		{
 			if (shader->attriblocations[i] == -1)
 				continue;
-			unsigned int name = shaderinfo->attribs[i];
-			if (name != posattribname)
-				return;
 			glDisableVertexAttribArray(shader->attriblocations[i]);
 		}
+		// Unbind the quad buffers
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	void VideoDriverOpenGL::drawOcclusionQueries(OcclusionQuery *query,
+	                                             OcclusionQuery::Request *requests,
+	                                             unsigned int count)
+	{
+		OcclusionQueryOpenGL *glquery = (OcclusionQueryOpenGL*)query;
+		// Read back the results of the last frames first so that their query
+		// objects can be reused, this never waits for the GPU
+		glquery->collectResults();
+		if (boxprogram == 0 || count == 0)
+			return;
+		// The boxes are tested against the depth buffer filled by the
+		// geometry of the camera, but must not modify any buffers
+		setBlendMode(BlendMode::Replace);
+		setDepthTest(DepthTest::LessEqual);
+		setDepthWrite(false);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		// The boxes are drawn from the static unit cube buffers
+		setVertexArray(0);
+		setVertexBuffer(0);
+		setIndexBuffer(0);
+		glBindBuffer(GL_ARRAY_BUFFER, boxvertexbuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxindexbuffer);
+		glUseProgram(boxprogram);
+		currentshader = 0;
+		currentuniforms = 0;
+		glUniformMatrix4fv(boxviewprojuniform, 1, GL_FALSE, viewprojmat.m);
+		glEnableVertexAttribArray(boxposattrib);
+		glVertexAttribPointer(boxposattrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		// One query per box
+		for (unsigned int i = 0; i < count; i++)
+		{
+			OcclusionQuery::Request &request = requests[i];
+			glUniform3f(boxminuniform,
+			            request.min[0],
+			            request.min[1],
+			            request.min[2]);
+			glUniform3f(boxsizeuniform,
+			            request.max[0] - request.min[0],
+			            request.max[1] - request.min[1],
+			            request.max[2] - request.min[2]);
+			unsigned int handle = glquery->allocateQuery();
+			glBeginQuery(GL_SAMPLES_PASSED, handle);
+			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+			glEndQuery(GL_SAMPLES_PASSED);
+			glquery->addPending(request, handle);
+		}
+		getStats().increaseUniformCallCount(1 + count * 2);
+		getStats().increaseOcclusionQueryCount(count);
+		// Restore the state
+		glDisableVertexAttribArray(boxposattrib);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	}
+	bool VideoDriverOpenGL::createBoxShader()
+	{
+		// Corner i of the unit cube is (i & 1, (i >> 1) & 1, (i >> 2) & 1),
+		// the triangles are counter-clockwise when seen from outside
+		float boxvertices[24] = {
+			0.0f, 0.0f, 0.0f,
+			1.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f,
+			1.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 1.0f,
+			1.0f, 0.0f, 1.0f,
+			0.0f, 1.0f, 1.0f,
+			1.0f, 1.0f, 1.0f
+		};
+		unsigned char boxindices[36] = {
+			0, 4, 6, 0, 6, 2,
+			1, 3, 7, 1, 7, 5,
+			0, 1, 5, 0, 5, 4,
+			2, 6, 7, 2, 7, 3,
+			0, 2, 3, 0, 3, 1,
+			4, 5, 7, 4, 7, 6
+		};
+		const char *vshadertext =
+			"uniform mat4 viewProjMat;\n"
+			"uniform vec3 boxMin;\n"
+			"uniform vec3 boxSize;\n"
+			"attribute vec3 pos;\n"
+			"void main()\n"
+			"{\n"
+			"	gl_Position = viewProjMat * vec4(boxMin + pos * boxSize, 1.0);\n"
+			"}\n";
+		const char *fshadertext =
+			"void main()\n"
+			"{\n"
+			"	gl_FragColor = vec4(1.0);\n"
+			"}\n";
+		unsigned int vshader = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vshader, 1, &vshadertext, NULL);
+		glCompileShader(vshader);
+		unsigned int fshader = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fshader, 1, &fshadertext, NULL);
+		glCompileShader(fshader);
+		boxprogram = glCreateProgram();
+		glAttachShader(boxprogram, vshader);
+		glAttachShader(boxprogram, fshader);
+		glLinkProgram(boxprogram);
+		// The shader objects are kept alive by the program
+		glDeleteShader(vshader);
+		glDeleteShader(fshader);
+		int status;
+		glGetProgramiv(boxprogram, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			glDeleteProgram(boxprogram);
+			boxprogram = 0;
+			return false;
+		}
+		boxminuniform = glGetUniformLocation(boxprogram, "boxMin");
+		boxsizeuniform = glGetUniformLocation(boxprogram, "boxSize");
+		boxviewprojuniform = glGetUniformLocation(boxprogram, "viewProjMat");
+		boxposattrib = glGetAttribLocation(boxprogram, "pos");
+		// Create the cube buffers
+		glGenBuffers(1, &boxvertexbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, boxvertexbuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(boxvertices), boxvertices,
+			GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glGenBuffers(1, &boxindexbuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxindexbuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(boxindices), boxindices,
+			GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		return true;
 	}
 
 	void VideoDriverOpenGL::beginFrame()
 	{
 		getStats().reset();
+		// Uploading and deleting textures changes the texture bindings
+		resetTextureUnits();
 		// Init static OpenGL states
 		glCullFace(GL_BACK);
 		glEnable(GL_CULL_FACE);
@@ -616,6 +774,8 @@ namespace opengl
 		// TODO: Unbind buffers, textures, program
 		glUseProgram(0);
 		currentshader = 0;
+		currentuniforms = 0;
+		setVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		currentvertices = 0;
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -629,12 +789,20 @@ namespace opengl
 	                                    math::Mat4f viewmat,
 	                                    math::Vec3f viewer)
 	{
+		// Deferred lights set the same camera for every quad
+		if (!memcmp(this->projmat.m, projmat.m, sizeof(projmat.m))
+		 && !memcmp(this->viewmat.m, viewmat.m, sizeof(viewmat.m))
+		 && this->viewer.x == viewer.x
+		 && this->viewer.y == viewer.y
+		 && this->viewer.z == viewer.z)
+			return;
 		this->projmat = projmat;
 		this->viewmat = viewmat;
 		viewmatinv = viewmat.inverse();
 		viewprojmat = projmat * viewmat;
 		this->viewer = viewer;
-		// TODO: These should not only updated in the shader when necessary
+		// Shaders upload the new matrices the next time they are used
+		camerageneration++;
 	}
 
 	void VideoDriverOpenGL::generateMipmaps(FrameBuffer::Configuration *fb)
@@ -649,6 +817,8 @@ namespace opengl
 				glGenerateMipmapEXT(type);
 				glDisable(type);
 				glBindTexture(type, 0);
+				textureunits[activetextureunit].type = type;
+				textureunits[activetextureunit].handle = 0;
 			}
 		}
 	}
@@ -777,8 +947,18 @@ namespace opengl
 			currentvertices = vertices;
 		}
 	}
+	void VideoDriverOpenGL::setVertexArray(unsigned int vertexarray)
+	{
+		if (vertexarray != currentvertexarray)
+		{
+			glBindVertexArray(vertexarray);
+			currentvertexarray = vertexarray;
+		}
+	}
 	void VideoDriverOpenGL::setIndexBuffer(IndexBuffer *indices)
 	{
+		// The index buffer binding is part of the vertex array object state,
+		// so this must only be called while no vertex array object is bound
 		if (indices != currentindices)
 		{
 			if (indices)
@@ -789,21 +969,43 @@ namespace opengl
 		}
 	}
 
-	void VideoDriverOpenGL::drawSingle(Batch *batch, const math::Mat4f &transmat)
+	void VideoDriverOpenGL::applyTransformation(Batch *batch,
+	                                            const math::Mat4f &transmat,
+	                                            const math::Mat4f *normalmat)
 	{
-		// Default uniforms (not dependant on the transformation matrix)
 		{
 			UniformLocations &locations = batch->shader->uniforms;
 			if (locations.worldmat != -1)
+			{
 				glUniformMatrix4fv(locations.worldmat, 1, GL_FALSE, transmat.m);
+				getStats().increaseUniformCallCount(1);
+			}
 			if (locations.worldnormalmat != -1)
 			{
-				// TODO: Is this correct?
-				math::Mat4f worldnormalmat = transmat.inverse().transposed();
-				glUniformMatrix4fv(locations.worldnormalmat, 1, GL_FALSE, worldnormalmat.m);
+				// The normal matrix is usually computed in
+				// FrameData::optimize(), but if the shader was recompiled
+				// after that and uses the uniform now we have to compute it
+				// here
+				if (normalmat)
+				{
+					glUniformMatrix4fv(locations.worldnormalmat, 1, GL_FALSE, normalmat->m);
+				}
+				else
+				{
+					math::Mat4f worldnormalmat = transmat.inverse().transposed();
+					glUniformMatrix4fv(locations.worldnormalmat, 1, GL_FALSE, worldnormalmat.m);
+				}
+				getStats().increaseUniformCallCount(1);
 			}
 			// TODO: Other uniforms
 		}
+	}
+	void VideoDriverOpenGL::drawSingle(Batch *batch,
+	                                   const math::Mat4f &transmat,
+	                                   const math::Mat4f *normalmat)
+	{
+		// Default uniforms (dependant on the transformation matrix)
+		applyTransformation(batch, transmat, normalmat);
 		// Render triangles
 		Mesh::MeshData *mesh = ((MeshOpenGL*)batch->mesh)->getData();
 		bool useindices = true;
@@ -837,6 +1039,7 @@ namespace opengl
 			}
 			// Increase polygon/batch counters
 			getStats().increaseBatchCount(1);
+			getStats().increaseDrawCallCount(1);
 			getStats().increasePolygonCount(indexcount / 3);
 		}
 		else
@@ -844,44 +1047,261 @@ namespace opengl
 			glDrawArrays(GL_QUADS, 0, mesh->vertexcount);
 			// TODO
 			getStats().increaseBatchCount(1);
+			getStats().increaseDrawCallCount(1);
 			getStats().increasePolygonCount(mesh->vertexcount / 4);
 		}
 	}
+	bool VideoDriverOpenGL::canDrawMerged(Batch *first, Batch *batch)
+	{
+		// The batches must not differ in any state or uniform
+		if (batch->shader != first->shader || batch->material != first->material)
+			return false;
+		if (batch->customuniforms != first->customuniforms
+		 || batch->customuniformcount != first->customuniformcount)
+			return false;
+		if (first->scissor || batch->scissor)
+			return false;
+		if (first->transmatcount != 0 || batch->transmatcount != 0)
+			return false;
+		if (first->skinmat || batch->skinmat)
+			return false;
+		if (memcmp(first->transmat.m, batch->transmat.m, sizeof(first->transmat.m)))
+			return false;
+		// The meshes have to use the same buffers and the same layout
+		Mesh::MeshData *firstmesh = ((MeshOpenGL*)first->mesh)->getData();
+		Mesh::MeshData *mesh = ((MeshOpenGL*)batch->mesh)->getData();
+		if (!firstmesh->indices || mesh->indices != firstmesh->indices)
+			return false;
+		if (mesh->vertices != firstmesh->vertices)
+			return false;
+		if (mesh->layout != firstmesh->layout
+		 || mesh->layoutchangecounter != firstmesh->layoutchangecounter)
+			return false;
+		if (mesh->indextype != firstmesh->indextype)
+			return false;
+		if (mesh->primitivetype == PrimitiveType::QuadList
+		 || mesh->primitivetype == PrimitiveType::TriangleList
+		 || firstmesh->primitivetype == PrimitiveType::QuadList
+		 || firstmesh->primitivetype == PrimitiveType::TriangleList)
+			return false;
+		int basevertex;
+		return getBaseVertex(firstmesh, mesh, basevertex);
+	}
+	bool VideoDriverOpenGL::getBaseVertex(Mesh::MeshData *first,
+	                                      Mesh::MeshData *mesh,
+	                                      int &basevertex)
+	{
+		basevertex = 0;
+		if (mesh->vertexoffset == first->vertexoffset)
+			return true;
+		// The attribs are set up with the vertex offset of the first mesh, so
+		// the other meshes have to be moved by a whole number of vertices
+		if (!caps.getFlag(RenderCaps::Flag::DrawBaseVertex))
+			return false;
+		VertexLayout *layout = first->layout;
+		if (layout->getElementCount() == 0)
+			return false;
+		unsigned int stride = layout->getElement(0)->stride;
+		if (stride == 0)
+			return false;
+		for (unsigned int i = 1; i < layout->getElementCount(); i++)
+		{
+			if (layout->getElement(i)->stride != stride)
+				return false;
+		}
+		int offset = (int)mesh->vertexoffset - (int)first->vertexoffset;
+		if (offset % (int)stride != 0)
+			return false;
+		basevertex = offset / (int)stride;
+		return true;
+	}
+	void VideoDriverOpenGL::drawMerged(Batch **batches, unsigned int count)
+	{
+		// All batches have the same transformation matrix
+		Batch *first = batches[0];
+		applyTransformation(first, first->transmat, first->normalmat);
+		// Collect the index ranges
+		Mesh::MeshData *firstmesh = ((MeshOpenGL*)first->mesh)->getData();
+		if (multidrawcounts.size() < count)
+		{
+			multidrawcounts.resize(count);
+			multidrawindices.resize(count);
+			multidrawbasevertices.resize(count);
+		}
+		bool usebasevertex = false;
+		unsigned int polygoncount = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			Mesh::MeshData *mesh = ((MeshOpenGL*)batches[i]->mesh)->getData();
+			multidrawcounts[i] = mesh->indexcount;
+			multidrawindices[i] = (char*)0 + mesh->startindex * mesh->indextype;
+			getBaseVertex(firstmesh, mesh, multidrawbasevertices[i]);
+			if (multidrawbasevertices[i] != 0)
+				usebasevertex = true;
+			polygoncount += mesh->indexcount / 3;
+		}
+		// Render triangles
+		GLenum indextype = GL_UNSIGNED_INT;
+		if (firstmesh->indextype == 1)
+			indextype = GL_UNSIGNED_BYTE;
+		else if (firstmesh->indextype == 2)
+			indextype = GL_UNSIGNED_SHORT;
+		if (usebasevertex)
+		{
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES,
+			                              &multidrawcounts[0],
+			                              indextype,
+			                              &multidrawindices[0],
+			                              count,
+			                              &multidrawbasevertices[0]);
+		}
+		else
+		{
+			glMultiDrawElements(GL_TRIANGLES,
+			                    &multidrawcounts[0],
+			                    indextype,
+			                    (const GLvoid**)&multidrawindices[0],
+			                    count);
+		}
+		// Increase polygon/batch counters
+		getStats().increaseBatchCount(count);
+		getStats().increaseDrawCallCount(1);
+		getStats().increasePolygonCount(polygoncount);
+	}
+	void VideoDriverOpenGL::prepareInstances(RenderQueue *queue)
+	{
+		instancereadoffset = 0;
+		instancereadend = 0;
+		// Count the instances of all batches which will be drawn via
+		// drawInstanced()
+		unsigned int instancecount = 0;
+		for (unsigned int i = 0; i < queue->batchcount; i++)
+		{
+			Batch *batch = queue->batches[i];
+			if (batch->shader->programobject == 0)
+				continue;
+			if (batch->transmatcount == 0 || !batch->shader->instancing)
+				continue;
+			instancecount += batch->transmatcount;
+		}
+		if (instancecount == 0)
+			return;
+		// Write all instance data into one contiguous range
+		unsigned int size = instancecount * INSTANCE_SIZE;
+		unsigned int offset;
+		float *data = mapInstanceBuffer(size, offset);
+		for (unsigned int i = 0; i < queue->batchcount; i++)
+		{
+			Batch *batch = queue->batches[i];
+			if (batch->shader->programobject == 0)
+				continue;
+			if (batch->transmatcount == 0 || !batch->shader->instancing)
+				continue;
+			writeInstances(data, batch->transmatlist, batch->transmatcount);
+			data += batch->transmatcount * 12;
+		}
+		unmapInstanceBuffer(offset, size);
+		// drawInstanced() consumes the data in the same order
+		instancereadoffset = offset;
+		instancereadend = offset + size;
+	}
+
+	float *VideoDriverOpenGL::mapInstanceBuffer(unsigned int size,
+	                                            unsigned int &offset)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+		currentvertices = 0;
+		if (instancebufferoffset + size > instancebuffersize)
+		{
+			// Orphan the buffer - the driver keeps the old storage alive
+			// until the GPU is done with it
+			if (size > instancebuffersize)
+				instancebuffersize = size;
+			glBufferData(GL_ARRAY_BUFFER, instancebuffersize, 0, GL_STREAM_DRAW);
+			instancebufferoffset = 0;
+		}
+		offset = instancebufferoffset;
+		instancebufferoffset += size;
+		if (mapbufferrange)
+		{
+			// The range has not been used since the buffer was orphaned, so
+			// we do not need to synchronize with the GPU
+			void *data = glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+				| GL_MAP_UNSYNCHRONIZED_BIT);
+			if (data)
+				return (float*)data;
+			log->warning("Could not map the instance buffer.");
+			mapbufferrange = false;
+		}
+		instancestaging.resize(size / sizeof(float));
+		return &instancestaging[0];
+	}
+	void VideoDriverOpenGL::unmapInstanceBuffer(unsigned int offset,
+	                                            unsigned int size)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+		currentvertices = 0;
+		if (mapbufferrange)
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		else
+			glBufferSubData(GL_ARRAY_BUFFER, offset, size, &instancestaging[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	void VideoDriverOpenGL::writeInstances(float *dest,
+	                                       const math::Mat4f *transmat,
+	                                       unsigned int count)
+	{
+		// Write the upper 3 rows of each (column-major) matrix
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const float *m = transmat[i].m;
+			for (unsigned int row = 0; row < 3; row++)
+			{
+				dest[0] = m[row];
+				dest[1] = m[row + 4];
+				dest[2] = m[row + 8];
+				dest[3] = m[row + 12];
+				dest += 4;
+			}
+		}
+	}
+
 	void VideoDriverOpenGL::drawInstanced(Batch *batch,
 	                                      unsigned int instancecount,
 	                                      math::Mat4f *transmat)
 	{
-		// Disable vertex buffer as we specify the transformation matrices as
-		// an attrib directly without using a buffer object
-		// TODO: Not using a buffer hits a slow path
-		//setVertexBuffer(0);
-		// Upload transformation matrices
-		glBindBuffer(GL_ARRAY_BUFFER, instancingbuffer);
-		glBufferData(GL_ARRAY_BUFFER, instancecount * 16 * sizeof(float),
-			transmat, GL_STREAM_DRAW);
-		// Set transMat attrib
-		if (batch->shader->transmatattrib != -1)
-		{
-			glEnableVertexAttribArray(batch->shader->transmatattrib);
-			glVertexAttribPointer(batch->shader->transmatattrib, 4, GL_FLOAT,
-				GL_FALSE, 16 * sizeof(float), 0);
-			glEnableVertexAttribArray(batch->shader->transmatattrib + 1);
-			glVertexAttribPointer(batch->shader->transmatattrib + 1, 4,
-				GL_FLOAT, GL_FALSE, 16 * sizeof(float),
-				(void*)(4 * sizeof(float)));
-			glEnableVertexAttribArray(batch->shader->transmatattrib + 2);
-			glVertexAttribPointer(batch->shader->transmatattrib + 2, 4,
-				GL_FLOAT, GL_FALSE, 16 * sizeof(float),
-				(void*)(8 * sizeof(float)));
-			glEnableVertexAttribArray(batch->shader->transmatattrib + 3);
-			glVertexAttribPointer(batch->shader->transmatattrib + 3, 4,
-				GL_FLOAT, GL_FALSE, 16 * sizeof(float),
-				(void*)(12 * sizeof(float)));
-			// Enable instancing
-			glVertexAttribDivisorARB(batch->shader->transmatattrib, 1);
-			glVertexAttribDivisorARB(batch->shader->transmatattrib + 1, 1);
-			glVertexAttribDivisorARB(batch->shader->transmatattrib + 2, 1);
-			glVertexAttribDivisorARB(batch->shader->transmatattrib + 3, 1);
+		// Get the transformation matrices from the instance buffer
+		unsigned int size = instancecount * INSTANCE_SIZE;
+		unsigned int offset;
+		if (instancereadoffset + size <= instancereadend)
+		{
+			offset = instancereadoffset;
+			instancereadoffset += size;
+		}
+		else
+		{
+			// Batch was not drawn as part of a render queue, upload it now
+			float *data = mapInstanceBuffer(size, offset);
+			writeInstances(data, transmat, instancecount);
+			unmapInstanceBuffer(offset, size);
+		}
+		// Set transMat attrib - the shader receives the rows of the matrix
+		// in the first three columns and has to multiply from the left
+		glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+		currentvertices = 0;
+		int transmatattrib = batch->shader->transmatattrib;
+		if (transmatattrib != -1)
+		{
+			for (unsigned int i = 0; i < 3; i++)
+			{
+				glEnableVertexAttribArray(transmatattrib + i);
+				glVertexAttribPointer(transmatattrib + i, 4, GL_FLOAT,
+					GL_FALSE, INSTANCE_SIZE,
+					(void*)(offset + i * 4 * sizeof(float)));
+				glVertexAttribDivisorARB(transmatattrib + i, 1);
+			}
+			glVertexAttrib4f(transmatattrib + 3, 0.0f, 0.0f, 0.0f, 1.0f);
 		}
 		// Render triangles
 		Mesh::MeshData *mesh = ((MeshOpenGL*)batch->mesh)->getData();
@@ -912,27 +1332,270 @@ namespace opengl
 		}
 		// Increase polygon/batch counters
 		getStats().increaseBatchCount(instancecount);
+		getStats().increaseDrawCallCount(1);
 		getStats().increasePolygonCount(indexcount / 3 * instancecount);
 		// Clean up buffer binding
-		setVertexBuffer(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		// Clean up attribs
-		if (batch->shader->transmatattrib != -1)
+		if (transmatattrib != -1)
 		{
-			glVertexAttribDivisorARB(batch->shader->transmatattrib, 0);
-			glVertexAttribDivisorARB(batch->shader->transmatattrib + 1, 0);
-			glVertexAttribDivisorARB(batch->shader->transmatattrib + 2, 0);
-			glVertexAttribDivisorARB(batch->shader->transmatattrib + 3, 0);
-			glDisableVertexAttribArray(batch->shader->transmatattrib);
-			glDisableVertexAttribArray(batch->shader->transmatattrib + 1);
-			glDisableVertexAttribArray(batch->shader->transmatattrib + 2);
-			glDisableVertexAttribArray(batch->shader->transmatattrib + 3);
+			for (unsigned int i = 0; i < 3; i++)
+			{
+				glVertexAttribDivisorARB(transmatattrib + i, 0);
+				glDisableVertexAttribArray(transmatattrib + i);
+			}
 		}
 	}
 
+	void VideoDriverOpenGL::applyAttribs(Batch *batch,
+	                                     Shader::ShaderInfo *shaderinfo,
+	                                     Mesh::MeshData *mesh)
+	{
+		for (unsigned int i = 0; i < shaderinfo->attribs.size(); i++)
+		{
+			int attribhandle = batch->shader->attriblocations[i];
+			if (attribhandle == -1)
+				continue;
+			unsigned int name = shaderinfo->attribs[i];
+			VertexLayoutElement *layoutelem = mesh->layout->getElementByName(name);
+			if (!layoutelem)
+				continue;
+			unsigned int opengltype = GL_FLOAT;
+			int normalize = layoutelem->normalize ? GL_TRUE : GL_FALSE;
+			switch (layoutelem->type)
+			{
+				case VertexElementType::Float:
+					opengltype = GL_FLOAT;
+					break;
+				case VertexElementType::DoubleFloat:
+					opengltype = GL_DOUBLE;
+					break;
+				case VertexElementType::HalfFloat:
+					// TODO
+					opengltype = GL_FLOAT;
+					break;
+				case VertexElementType::Integer:
+					opengltype = GL_INT;
+					break;
+				case VertexElementType::Short:
+					opengltype = GL_SHORT;
+					break;
+				case VertexElementType::Byte:
+					opengltype = GL_BYTE;
+					break;
+				case VertexElementType::UnsignedInteger:
+					opengltype = GL_UNSIGNED_INT;
+					break;
+				case VertexElementType::UnsignedShort:
+					opengltype = GL_UNSIGNED_SHORT;
+					break;
+				case VertexElementType::UnsignedByte:
+					opengltype = GL_UNSIGNED_BYTE;
+					break;
+			}
+			glEnableVertexAttribArray(attribhandle);
+			glVertexAttribPointer(attribhandle,
+			                      layoutelem->components,
+			                      opengltype,
+			                      normalize,
+			                      layoutelem->stride,
+			                      (void*)(layoutelem->offset + mesh->vertexoffset));
+		}
+	}
+	void VideoDriverOpenGL::applyCustomUniforms(Batch *batch,
+	                                            Shader::ShaderInfo *shaderinfo)
+	{
+		ShaderCombination *shader = batch->shader;
+		unsigned int uniformcalls = 0;
+		// Look up which uniforms are overridden by the batch
+		unsigned int uniformcount = shaderinfo->uniforms.size();
+		if (uniformoverrides.size() < uniformcount)
+			uniformoverrides.resize(uniformcount);
+		for (unsigned int i = 0; i < uniformcount; i++)
+			uniformoverrides[i] = 0;
+		const std::vector<int> &uniformindices = batch->shader->customuniformindices;
+		for (unsigned int i = 0; i < batch->customuniformcount; i++)
+		{
+			unsigned int name = batch->customuniforms[i].name;
+			if (name >= uniformindices.size() || uniformindices[name] == -1)
+				continue;
+			uniformoverrides[uniformindices[name]] = &batch->customuniforms[i];
+		}
+		for (unsigned int i = 0; i < uniformcount; i++)
+		{
+			// Get uniform shader handle
+			int uniformhandle = batch->shader->customuniforms[i];
+			if (uniformhandle == -1)
+				continue;
+			// Get uniform data
+			unsigned int size = 0;
+			float *data = 0;
+			if (uniformoverrides[i])
+			{
+				size = uniformoverrides[i]->size;
+				data = uniformoverrides[i]->data;
+			}
+			else
+			{
+				size = shaderinfo->uniforms[i].size;
+				data = shaderinfo->uniforms[i].defvalue;
+			}
+			// Disallow uploading of more than 4x4 matrices
+			if (size > 16)
+				size = 16;
+			// Skip the uniform if the program still contains the value
+			if (i < shader->customuniformcachesize.size())
+			{
+				float *cached = &shader->customuniformcache[i * 16];
+				if (shader->customuniformcachesize[i] == size
+				 && !memcmp(cached, data, size * sizeof(float)))
+					continue;
+				shader->customuniformcachesize[i] = size;
+				memcpy(cached, data, size * sizeof(float));
+			}
+			uniformcalls++;
+			// Upload uniform value
+			// TODO: Integer uniforms?
+			switch (size)
+			{
+				case 1:
+					glUniform1f(uniformhandle, data[0]);
+					break;
+				case 2:
+					glUniform2f(uniformhandle, data[0], data[1]);
+					break;
+				case 3:
+					glUniform3f(uniformhandle, data[0], data[1], data[2]);
+					break;
+				case 4:
+					glUniform4f(uniformhandle, data[0], data[1], data[2], data[3]);
+					break;
+				case 9:
+					glUniformMatrix3fv(uniformhandle, 1, GL_FALSE, data);
+					break;
+				case 12:
+					glUniformMatrix4x3fv(uniformhandle, 1, GL_FALSE, data);
+					break;
+				case 16:
+					glUniformMatrix4fv(uniformhandle, 1, GL_FALSE, data);
+					break;
+			}
+		}
+		getStats().increaseUniformCallCount(uniformcalls);
+	}
+	void VideoDriverOpenGL::applyCameraUniforms(ShaderCombination *shader)
+	{
+		// Only upload the uniforms if they changed since the last upload
+		if (shader->camerageneration == camerageneration)
+			return;
+		shader->camerageneration = camerageneration;
+		unsigned int uniformcalls = 0;
+		UniformLocations &locations = shader->uniforms;
+		if (locations.projmat != -1)
+		{
+			glUniformMatrix4fv(locations.projmat, 1, GL_FALSE, projmat.m);
+			uniformcalls++;
+		}
+		if (locations.viewmat != -1)
+		{
+			glUniformMatrix4fv(locations.viewmat, 1, GL_FALSE, viewmat.m);
+			uniformcalls++;
+		}
+		if (locations.viewmatinv != -1)
+		{
+			glUniformMatrix4fv(locations.viewmatinv, 1, GL_FALSE, viewmatinv.m);
+			uniformcalls++;
+		}
+		if (locations.viewprojmat != -1)
+		{
+			glUniformMatrix4fv(locations.viewprojmat, 1, GL_FALSE, viewprojmat.m);
+			uniformcalls++;
+		}
+		if (locations.viewerpos != -1)
+		{
+			glUniform3f(locations.viewerpos, viewer.x, viewer.y, viewer.z);
+			uniformcalls++;
+		}
+		if (locations.framebufsize != -1)
+		{
+			glUniform2f(locations.framebufsize, viewport[2], viewport[3]);
+			uniformcalls++;
+		}
+		getStats().increaseUniformCallCount(uniformcalls);
+	}
+	void VideoDriverOpenGL::applyLightUniforms(ShaderCombination *shader)
+	{
+		LightUniforms *light = getLightUniforms();
+		if (!light)
+			return;
+		UniformLocations &locations = shader->uniforms;
+		// The shadow map has to be bound every time as other shaders might
+		// have used the texture unit in the meantime
+		unsigned int shadowmapunit = shader->shader->getUploadedData()->samplers.size();
+		if (locations.shadowmap != -1 && light->shadowmap)
+			bindTexture(shadowmapunit, GL_TEXTURE_2D, light->shadowmap->getHandle());
+		// Only upload the uniforms if they changed since the last upload
+		if (shader->lightgeneration == getLightGeneration())
+			return;
+		shader->lightgeneration = getLightGeneration();
+		unsigned int uniformcalls = 0;
+		if (locations.lightpos != -1)
+		{
+			glUniform4f(locations.lightpos,
+			            light->position[0],
+			            light->position[1],
+			            light->position[2],
+			            light->position[3]);
+			uniformcalls++;
+		}
+		if (locations.lightdir != -1)
+		{
+			glUniform3f(locations.lightdir,
+			            light->direction[0],
+			            light->direction[1],
+			            light->direction[2]);
+			uniformcalls++;
+		}
+		if (locations.lightcolor != -1)
+		{
+			glUniform4f(locations.lightcolor,
+			            light->color[0],
+			            light->color[1],
+			            light->color[2],
+			            light->color[3]);
+			uniformcalls++;
+		}
+		if (locations.shadowmat != -1)
+		{
+			glUniformMatrix4fv(locations.shadowmat, 1, GL_FALSE, light->shadowmat.m);
+			uniformcalls++;
+		}
+		if (locations.shadowmap != -1 && light->shadowmap)
+		{
+			glUniform1i(locations.shadowmap, shadowmapunit);
+			uniformcalls++;
+		}
+		getStats().increaseUniformCallCount(uniformcalls);
+	}
 	void VideoDriverOpenGL::applyTextures(ShaderCombination *shader,
 	                                      Material *material)
 	{
 		Shader::ShaderInfo *shaderinfo = shader->shader->getUploadedData();
+		// The texture units of the samplers never change, so they only have
+		// to be set once per program
+		if (!shader->samplerunitsset)
+		{
+			unsigned int uniformcalls = 0;
+			for (unsigned int i = 0; i < shader->samplerlocations.size(); i++)
+			{
+				if (shader->samplerlocations[i] == -1)
+					continue;
+				glUniform1i(shader->samplerlocations[i], i);
+				uniformcalls++;
+			}
+			shader->samplerunitsset = true;
+			getStats().increaseUniformCallCount(uniformcalls);
+		}
 		// Apply textures
 		for (unsigned int i = 0; i < shaderinfo->samplers.size(); i++)
 		{
@@ -981,12 +1644,41 @@ namespace opengl
 					break;
 			}
 			// TODO: Better manage texture units
-			glActiveTexture(GL_TEXTURE0 + i);
-			glBindTexture(opengltype, texture->getHandle());
-			glUniform1i(samplerhandle, i);
+			bindTexture(i, opengltype, texture->getHandle());
 			// TODO: Take care of unbinding textures later?
 		}
 	}
+	void VideoDriverOpenGL::bindTexture(unsigned int unit,
+	                                    unsigned int type,
+	                                    unsigned int handle)
+	{
+		if (unit < MAX_TEXTURE_UNITS)
+		{
+			// Skip the bind if the texture is still bound
+			if (textureunits[unit].type == type
+			 && textureunits[unit].handle == handle)
+				return;
+			textureunits[unit].type = type;
+			textureunits[unit].handle = handle;
+		}
+		if (unit != activetextureunit)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			activetextureunit = unit;
+		}
+		glBindTexture(type, handle);
+		getStats().increaseTextureBindCount(1);
+	}
+	void VideoDriverOpenGL::resetTextureUnits()
+	{
+		glActiveTexture(GL_TEXTURE0);
+		activetextureunit = 0;
+		for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+		{
+			textureunits[i].type = 0;
+			textureunits[i].handle = 0;
+		}
+	}
 
 	render::Image *VideoDriverOpenGL::takeScreenshot(int x, int y, int width, int height)
 	{
@@ -57,6 +57,7 @@ namespace opengl
 			                                           res::ResourceManager *rmgr,
 			                                           const std::string &name);
 			virtual Mesh::Ptr createMesh(UploadManager &uploadmgr);
+			virtual OcclusionQuery::Ptr createOcclusionQuery(UploadManager &uploadmgr);
 
 			virtual void setRenderTarget(const RenderTargetInfo *target);
 			virtual void setViewport(unsigned int x,
@@ -68,11 +69,21 @@ namespace opengl
 			                   float depth);
 
 			virtual void draw(Batch *batch);
+			virtual unsigned int drawMultiple(Batch **batches,
+			                                  unsigned int count);
+			virtual void prepareInstances(RenderQueue *queue);
 
 			virtual void drawQuad(float *vertices,
 			                      ShaderCombination *shader,
 			                      Material *material,
 			                      LightUniforms *light);
+			virtual void drawQuads(QuadInstance *quads,
+			                       unsigned int count,
+			                       ShaderCombination *shader,
+			                       Material *material);
+			virtual void drawOcclusionQueries(OcclusionQuery *query,
+			                                  OcclusionQuery::Request *requests,
+			                                  unsigned int count);
 
 			virtual void beginFrame();
 			virtual void endFrame();
@@ -105,13 +116,49 @@ namespace opengl
 			void setBlendMode(BlendMode::List mode);
 			void setVertexBuffer(VertexBuffer *vertices);
 			void setIndexBuffer(IndexBuffer *indices);
+			void setVertexArray(unsigned int vertexarray);
 
-			void drawSingle(Batch *batch, const math::Mat4f &transmat);
+			bool applyBatchState(Batch *batch, bool &usevertexarray);
+			void cleanupAttribs(Batch *batch, bool usevertexarray);
+			void applyTransformation(Batch *batch,
+			                         const math::Mat4f &transmat,
+			                         const math::Mat4f *normalmat);
+
+			bool canDrawMerged(Batch *first, Batch *batch);
+			bool getBaseVertex(Mesh::MeshData *first,
+			                   Mesh::MeshData *mesh,
+			                   int &basevertex);
+			void drawMerged(Batch **batches, unsigned int count);
+			void drawSingle(Batch *batch,
+			                const math::Mat4f &transmat,
+			                const math::Mat4f *normalmat);
 			void drawInstanced(Batch *batch,
 			                   unsigned int instancecount,
 			                   math::Mat4f *transmat);
 
+			float *mapInstanceBuffer(unsigned int size, unsigned int &offset);
+			void unmapInstanceBuffer(unsigned int offset, unsigned int size);
+			static void writeInstances(float *dest,
+			                           const math::Mat4f *transmat,
+			                           unsigned int count);
+
+			bool applyQuadState(ShaderCombination *shader, Material *material);
+			void cleanupQuadState(ShaderCombination *shader);
+
+			bool createBoxShader();
+
+			void applyAttribs(Batch *batch,
+			                  Shader::ShaderInfo *shaderinfo,
+			                  Mesh::MeshData *mesh);
+			void applyCustomUniforms(Batch *batch,
+			                         Shader::ShaderInfo *shaderinfo);
+			void applyCameraUniforms(ShaderCombination *shader);
+			void applyLightUniforms(ShaderCombination *shader);
 			void applyTextures(ShaderCombination *shader, Material *material);
+			void bindTexture(unsigned int unit,
+			                 unsigned int type,
+			                 unsigned int handle);
+			void resetTextureUnits();
 
 			RenderCapsOpenGL caps;
 
@@ -119,8 +166,13 @@ namespace opengl
 
 			FrameBuffer::Configuration *currentfb;
 			ShaderCombination *currentshader;
+			/**
+			 * Custom uniforms which were last uploaded to currentshader.
+			 */
+			CustomUniform *currentuniforms;
 			VertexBuffer *currentvertices;
 			IndexBuffer *currentindices;
+			unsigned int currentvertexarray;
 
 			BlendMode::List currentblendmode;
 			bool currentdepthwrite;
@@ -132,10 +184,90 @@ namespace opengl
 			math::Mat4f viewmatinv;
 			math::Mat4f viewprojmat;
 			math::Vec3f viewer;
+			/**
+			 * Incremented whenever the camera matrices or the viewport size
+			 * change, compared against ShaderCombination::camerageneration.
+			 */
+			unsigned int camerageneration;
 
 			unsigned int viewport[4];
 
-			unsigned int instancingbuffer;
+			/**
+			 * Streaming buffer for the transformation matrices of instanced
+			 * batches. The buffer is used as a ring buffer and is only
+			 * orphaned once it runs full, so writing to it never has to wait
+			 * for the GPU.
+			 */
+			unsigned int instancebuffer;
+			unsigned int instancebuffersize;
+			unsigned int instancebufferoffset;
+			/**
+			 * Part of the instance buffer which was filled by
+			 * prepareInstances() and not yet consumed by drawInstanced().
+			 */
+			unsigned int instancereadoffset;
+			unsigned int instancereadend;
+			/**
+			 * True if glMapBufferRange() is available, otherwise the data is
+			 * written to instancestaging and uploaded via glBufferSubData().
+			 */
+			bool mapbufferrange;
+			std::vector<float> instancestaging;
+			/**
+			 * Size of the data of a single instance. Only the upper 3 rows of
+			 * the transformation matrix are uploaded, the last row is always
+			 * (0, 0, 0, 1).
+			 */
+			static const unsigned int INSTANCE_SIZE = 12 * sizeof(float);
+			static const unsigned int INSTANCE_BUFFER_SIZE = 65536 * INSTANCE_SIZE;
+			/**
+			 * Size of the data of a single quad drawn by drawQuads() (quad
+			 * rectangle, light position, color and direction).
+			 */
+			static const unsigned int QUAD_INSTANCE_SIZE = 16 * sizeof(float);
+
+			/**
+			 * Static unit quad used by drawQuad() and drawQuads().
+			 */
+			unsigned int quadvertexbuffer;
+			unsigned int quadindexbuffer;
+
+			/**
+			 * Static unit cube and shader used by drawOcclusionQueries().
+			 */
+			unsigned int boxvertexbuffer;
+			unsigned int boxindexbuffer;
+			unsigned int boxprogram;
+			int boxminuniform;
+			int boxsizeuniform;
+			int boxviewprojuniform;
+			int boxposattrib;
+
+			/**
+			 * Textures currently bound to the texture units, used to skip
+			 * redundant texture binds.
+			 */
+			static const unsigned int MAX_TEXTURE_UNITS = 32;
+			struct TextureUnit
+			{
+				unsigned int type;
+				unsigned int handle;
+			};
+			TextureUnit textureunits[MAX_TEXTURE_UNITS];
+			unsigned int activetextureunit;
+
+			/**
+			 * Batch uniform for every custom uniform of the current shader,
+			 * reused for all batches to prevent allocations in draw().
+			 */
+			std::vector<CustomUniform*> uniformoverrides;
+			/**
+			 * Parameters for glMultiDrawElements(), reused for all merged
+			 * draw calls.
+			 */
+			std::vector<int> multidrawcounts;
+			std::vector<void*> multidrawindices;
+			std::vector<int> multidrawbasevertices;
 	};
 
 }
@@ -93,11 +93,24 @@ namespace scene
 		// Render mesh
 		const std::vector<Model::Batch> &batches = model->getBatches();
 		const std::vector<Model::BatchGeometry> &geometry = model->getGeometry();
-		// TODO: Culling
 		core::MemoryPool *memory = queue.memory;
 		for (unsigned int i = 0; i < batches.size(); i++)
 		{
-			render::Batch *batch = model->prepareBatch(queue, i, false, true);
+			// Skip batches outside of the view frustum or hidden behind
+			// occluders
+			if (queue.clipping.isEnabled() || queue.occlusion)
+			{
+				math::BoundingBox box;
+				if (getBatchBox(i, animatednodes, box)
+				 && !Model::isBoxVisible(queue, box, transmat))
+					continue;
+			}
+			math::Mat4f batchtransmat = transmat * animatednodes[batches[i].node].abstrans;
+			render::Batch *batch = model->prepareBatch(queue,
+			                                           i,
+			                                           batchtransmat,
+			                                           false,
+			                                           true);
 			if (!batch)
 				continue;
 			// Skinning
@@ -105,8 +118,8 @@ namespace scene
 			{
 				const Model::BatchGeometry *geom = &geometry[batches[i].geometry];
 				unsigned int jointcount = geom->joints.size();
-				void *ptr = memory->allocate(sizeof(float) * 16 * jointcount);
-				float *skinmatrices = (float*)ptr;
+				float *skinmatrices = memory->allocateArray<float>(16 * jointcount,
+				                      core::MemoryPool::SIMD_ALIGNMENT);
 				for (unsigned int j = 0; j < jointcount; j++)
 				{
 					int jointnode = geom->joints[j].node;
@@ -128,12 +141,10 @@ namespace scene
 			}
 			else
 			{
-				batch->transmat = transmat * animatednodes[batches[i].node].abstrans;
 				batch->transmatcount = 0;
 			}
 			// Add batch to the render queue
-			tbb::mutex::scoped_lock lock(queue.batchmutex);
-			queue.batches.push_back(batch);
+			queue.addBatch(batch);
 		}
 	}
 	void AnimatedModel::render(render::RenderQueue &queue,
@@ -141,21 +152,48 @@ namespace scene
 	                          math::Mat4f *transmat)
 	{
 		core::MemoryPool *memory = queue.memory;
-		// Create transformation matrix list
-		unsigned int memsize = sizeof(math::Mat4f) * instancecount;
-		math::Mat4f *matrices = (math::Mat4f*)memory->allocate(memsize);
-		for (unsigned int i = 0; i < instancecount; i++)
-			matrices[i] = transmat[i];
+		// Create transformation matrix list, if the queue has a view frustum
+		// or an occlusion buffer every batch gets its own list containing
+		// only the visible instances
+		math::Mat4f *matrices = 0;
+		if (!queue.clipping.isEnabled() && !queue.occlusion)
+		{
+			matrices = memory->allocateArray<math::Mat4f>(instancecount,
+			           core::MemoryPool::SIMD_ALIGNMENT);
+			for (unsigned int i = 0; i < instancecount; i++)
+				matrices[i] = transmat[i];
+		}
 		// Compute animation data for all nodes
 		std::vector<Model::Node> animatednodes = model->getNodes();
 		applyAnimation(animatednodes);
 			// Render mesh
 		const std::vector<Model::Batch> &batches = model->getBatches();
 		const std::vector<Model::BatchGeometry> &geometry = model->getGeometry();
-		// TODO: Culling
 		for (unsigned int i = 0; i < batches.size(); i++)
 		{
-			render::Batch *batch = model->prepareBatch(queue, i, true, true);
+			math::Mat4f *visiblematrices = matrices;
+			unsigned int visiblecount = instancecount;
+			// Only pass the visible instances
+			if (!matrices)
+			{
+				math::BoundingBox box;
+				if (!getBatchBox(i, animatednodes, box))
+					continue;
+				visiblematrices = memory->allocateArray<math::Mat4f>(instancecount,
+				                  core::MemoryPool::SIMD_ALIGNMENT);
+				visiblecount = Model::cullInstances(queue,
+				                                    box,
+				                                    instancecount,
+				                                    transmat,
+				                                    visiblematrices);
+				if (visiblecount == 0)
+					continue;
+			}
+			render::Batch *batch = model->prepareBatch(queue,
+			                                           i,
+			                                           animatednodes[batches[i].node].abstrans,
+			                                           true,
+			                                           true);
 			if (!batch)
 				continue;
 			// Skinning
@@ -163,8 +201,8 @@ namespace scene
 			{
 				const Model::BatchGeometry *geom = &geometry[batches[i].geometry];
 				unsigned int jointcount = geom->joints.size();
-				void *ptr = memory->allocate(sizeof(float) * 16 * jointcount);
-				float *skinmatrices = (float*)ptr;
+				float *skinmatrices = memory->allocateArray<float>(16 * jointcount,
+				                      core::MemoryPool::SIMD_ALIGNMENT);
 				for (unsigned int j = 0; j < jointcount; j++)
 				{
 					int jointnode = geom->joints[j].node;
@@ -182,19 +220,44 @@ namespace scene
 				batch->skinmat = skinmatrices;
 				batch->skinmatcount = jointcount;
 				batch->transmat = math::Mat4f::Identity();
-				batch->transmatcount = instancecount;
-				batch->transmatlist = matrices;
+				batch->transmatcount = visiblecount;
+				batch->transmatlist = visiblematrices;
 			}
 			else
 			{
-				batch->transmat = animatednodes[batches[i].node].abstrans;
-				batch->transmatcount = instancecount;
-				batch->transmatlist = matrices;
+				batch->transmatcount = visiblecount;
+				batch->transmatlist = visiblematrices;
 			}
 			// Add batch to the render queue
-			tbb::mutex::scoped_lock lock(queue.batchmutex);
-			queue.batches.push_back(batch);
+			queue.addBatch(batch);
+		}
+	}
+
+	bool AnimatedModel::getBatchBox(unsigned int batchindex,
+	                                const std::vector<Model::Node> &animatednodes,
+	                                math::BoundingBox &box)
+	{
+		const Model::Batch &batch = model->getBatches()[batchindex];
+		const std::vector<Model::BatchGeometry> &geometry = model->getGeometry();
+		if (batch.geometry >= geometry.size() || batch.node >= animatednodes.size())
+			return false;
+		const Model::BatchGeometry *geom = &geometry[batch.geometry];
+		// Box without skinning
+		box = render::Frustum::transformBox(geom->boundingbox,
+		                                    animatednodes[batch.node].abstrans);
+		// Box with skinning, computed as the union of the box transformed
+		// by every joint
+		for (unsigned int i = 0; i < geom->joints.size(); i++)
+		{
+			int jointnode = geom->joints[i].node;
+			if (jointnode == -1)
+				continue;
+			math::Mat4f jointmat = animatednodes[jointnode].abstrans * geom->joints[i].jointmat;
+			box = render::Frustum::mergeBoxes(box,
+			                                  render::Frustum::transformBox(geom->boundingbox,
+			                                                                jointmat));
 		}
+		return true;
 	}
 
 	float AnimatedModel::applyStage(unsigned int stageindex,
@@ -22,6 +22,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/scene/Light.hpp"
 #include "CoreRender/render/FrameData.hpp"
 
+#include <algorithm>
+
 namespace cr
 {
 namespace scene
@@ -53,6 +55,47 @@ namespace scene
 	{
 	}
 
+	bool Light::getScreenRect(Camera::Ptr camera,
+	                          const math::BoundingBox &box,
+	                          float *quad)
+	{
+		math::Mat4f viewprojmat = camera->getProjMat() * camera->getViewMat();
+		const float *m = viewprojmat.m;
+		quad[0] = 1.0f;
+		quad[1] = 1.0f;
+		quad[2] = -1.0f;
+		quad[3] = -1.0f;
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			float x = (i & 1) ? box.maxCorner.x : box.minCorner.x;
+			float y = (i & 2) ? box.maxCorner.y : box.minCorner.y;
+			float z = (i & 4) ? box.maxCorner.z : box.minCorner.z;
+			float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+			if (w <= 0.0f)
+			{
+				// The box reaches behind the camera, we cannot get a useful
+				// rectangle from the corners
+				quad[0] = -1.0f;
+				quad[1] = -1.0f;
+				quad[2] = 1.0f;
+				quad[3] = 1.0f;
+				return true;
+			}
+			float screenx = (m[0] * x + m[4] * y + m[8] * z + m[12]) / w;
+			float screeny = (m[1] * x + m[5] * y + m[9] * z + m[13]) / w;
+			quad[0] = std::min(quad[0], screenx);
+			quad[1] = std::min(quad[1], screeny);
+			quad[2] = std::max(quad[2], screenx);
+			quad[3] = std::max(quad[3], screeny);
+		}
+		// Clamp the rectangle to the screen
+		quad[0] = std::max(quad[0], -1.0f);
+		quad[1] = std::max(quad[1], -1.0f);
+		quad[2] = std::min(quad[2], 1.0f);
+		quad[3] = std::min(quad[3], 1.0f);
+		return quad[0] < quad[2] && quad[1] < quad[3];
+	}
+
 	void Light::getLightInfo(render::LightUniforms *uniforms)
 	{
 		uniforms->color[0] = color.getRed();
@@ -23,6 +23,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/res/ResourceManager.hpp"
 #include "../3rdparty/tinyxml.h"
 #include "CoreRender/render/FrameData.hpp"
+#include "CoreRender/render/OcclusionBuffer.hpp"
 #include "CoreRender/core/MemoryPool.hpp"
 #include "CoreRender/GraphicsEngine.hpp"
 
@@ -42,19 +43,26 @@ namespace scene
 	}
 
 	void Model::render(render::RenderQueue &queue,
-	                  math::Mat4f transmat)
+	                  math::Mat4f transmat,
+	                  bool testocclusion)
 	{
-		// TODO: Culling
 		for (unsigned int i = 0; i < batches.size(); i++)
 		{
+			// Skip batches outside of the view frustum or hidden behind
+			// occluders
+			math::Mat4f batchtransmat = transmat * nodes[batches[i].node].abstrans;
+			if (!isBatchVisible(queue, i, batchtransmat, testocclusion))
+				continue;
 			// Create batch
-			render::Batch *batch = prepareBatch(queue, i, false, false);
+			render::Batch *batch = prepareBatch(queue,
+			                                    i,
+			                                    batchtransmat,
+			                                    false,
+			                                    false);
 			if (!batch)
 				continue;
-			batch->transmat = transmat * nodes[batches[i].node].abstrans;
 			// Add batch to the render queue
-			tbb::mutex::scoped_lock lock(queue.batchmutex);
-			queue.batches.push_back(batch);
+			queue.addBatch(batch);
 		}
 	}
 	void Model::render(render::RenderQueue &queue,
@@ -62,30 +70,109 @@ namespace scene
 	                  math::Mat4f *transmat)
 	{
 		core::MemoryPool *memory = queue.memory;
-		// Create transformation matrix list
-		unsigned int memsize = sizeof(math::Mat4f) * instancecount;
-		math::Mat4f *matrices = (math::Mat4f*)memory->allocate(memsize);
-		for (unsigned int i = 0; i < instancecount; i++)
-			matrices[i] = transmat[i];
+		// Create transformation matrix list, if the queue has a view frustum
+		// or an occlusion buffer every batch gets its own list containing
+		// only the visible instances
+		math::Mat4f *matrices = 0;
+		if (!queue.clipping.isEnabled() && !queue.occlusion)
+		{
+			matrices = memory->allocateArray<math::Mat4f>(instancecount,
+			           core::MemoryPool::SIMD_ALIGNMENT);
+			for (unsigned int i = 0; i < instancecount; i++)
+				matrices[i] = transmat[i];
+		}
 		// Create batches
-		// TODO: Culling
 		for (unsigned int i = 0; i < batches.size(); i++)
 		{
+			if (batches[i].geometry >= geometry.size())
+				continue;
+			math::Mat4f *visiblematrices = matrices;
+			unsigned int visiblecount = instancecount;
+			// Only pass the visible instances
+			if (!matrices)
+			{
+				visiblematrices = memory->allocateArray<math::Mat4f>(instancecount,
+				                  core::MemoryPool::SIMD_ALIGNMENT);
+				const math::BoundingBox &box = geometry[batches[i].geometry].boundingbox;
+				visiblecount = cullInstances(queue,
+				                             box,
+				                             instancecount,
+				                             transmat,
+				                             visiblematrices);
+				if (visiblecount == 0)
+					continue;
+			}
 			// Create batch
-			render::Batch *batch = prepareBatch(queue, i, true, false);
+			render::Batch *batch = prepareBatch(queue,
+			                                    i,
+			                                    math::Mat4f::Identity(),
+			                                    true,
+			                                    false);
 			if (!batch)
 				continue;
-			batch->transmat = math::Mat4f::Identity();
-			batch->transmatcount = instancecount;
-			batch->transmatlist = matrices;
+			batch->transmatcount = visiblecount;
+			batch->transmatlist = visiblematrices;
 			// Add batch to the render queue
-			tbb::mutex::scoped_lock lock(queue.batchmutex);
-			queue.batches.push_back(batch);
+			queue.addBatch(batch);
 		}
 	}
 
+	bool Model::isBatchVisible(render::RenderQueue &queue,
+	                           unsigned int batchindex,
+	                           const math::Mat4f &transmat,
+	                           bool testocclusion)
+	{
+		unsigned int geometryindex = batches[batchindex].geometry;
+		if (geometryindex >= geometry.size())
+			return true;
+		const math::BoundingBox &box = geometry[geometryindex].boundingbox;
+		return isBoxVisible(queue, box, transmat, testocclusion);
+	}
+	bool Model::isBoxVisible(render::RenderQueue &queue,
+	                         const math::BoundingBox &box,
+	                         const math::Mat4f &transmat,
+	                         bool testocclusion)
+	{
+		if (!queue.clipping.isVisible(box, transmat))
+			return false;
+		if (testocclusion && queue.occlusion
+		 && !queue.occlusion->isVisible(render::Frustum::transformBox(box, transmat)))
+			return false;
+		return true;
+	}
+	unsigned int Model::cullInstances(render::RenderQueue &queue,
+	                                  const math::BoundingBox &box,
+	                                  unsigned int instancecount,
+	                                  const math::Mat4f *transmat,
+	                                  math::Mat4f *visible)
+	{
+		unsigned int visiblecount = instancecount;
+		if (queue.clipping.isEnabled())
+		{
+			visiblecount = queue.clipping.cullInstances(box,
+			                                            transmat,
+			                                            instancecount,
+			                                            visible);
+		}
+		else
+		{
+			for (unsigned int i = 0; i < instancecount; i++)
+				visible[i] = transmat[i];
+		}
+		if (queue.occlusion && visiblecount != 0)
+		{
+			// Remove hidden instances
+			visiblecount = queue.occlusion->cullInstances(box,
+			                                              visible,
+			                                              visiblecount,
+			                                              visible);
+		}
+		return visiblecount;
+	}
+
 	render::Batch *Model::prepareBatch(render::RenderQueue &queue,
 	                                  unsigned int batchindex,
+	                                  const math::Mat4f &transmat,
 	                                  bool instancing,
 	                                  bool skinning)
 	{
@@ -98,6 +185,7 @@ namespace scene
 			return 0;
 		return queue.prepareBatch(meshbatch.material.get(),
 		                          geometry[meshbatch.geometry].mesh.get(),
+		                          transmat,
 		                          instancing,
 		                          skinning);
 		/*core::MemoryPool *memory = queue.memory;
@@ -282,6 +370,36 @@ namespace scene
 		return success;
 	}
 
+	static void computeBoundingBox(const GeometryFile::AttribInfo &attribs,
+	                               const GeometryFile::GeometryInfo &geom,
+	                               void *vertexdata,
+	                               unsigned int vertexdatasize,
+	                               float *boundingbox)
+	{
+		for (unsigned int i = 0; i < 6; i++)
+			boundingbox[i] = 0.0f;
+		if (!(attribs.flags & GeometryFile::AttribFlags::HasPositions))
+			return;
+		if (attribs.stride == 0
+		 || geom.vertexoffset + geom.vertexsize > vertexdatasize)
+			return;
+		unsigned int vertexcount = geom.vertexsize / attribs.stride;
+		char *vertices = (char*)vertexdata + geom.vertexoffset;
+		for (unsigned int i = 0; i < vertexcount; i++)
+		{
+			float pos[3];
+			memcpy(pos, vertices + i * attribs.stride + attribs.posoffset,
+			       sizeof(pos));
+			for (unsigned int j = 0; j < 3; j++)
+			{
+				if (i == 0 || pos[j] < boundingbox[j])
+					boundingbox[j] = pos[j];
+				if (i == 0 || pos[j] > boundingbox[j + 3])
+					boundingbox[j + 3] = pos[j];
+			}
+		}
+	}
+
 	bool Model::loadGeometryFile(std::string filename)
 	{
 		// Open file
@@ -303,7 +421,7 @@ namespace scene
 			return false;
 		}
 		if (header.tag != GeometryFile::tag
-		 || header.version != GeometryFile::version)
+		 || header.version > GeometryFile::version)
 		{
 			getManager()->getLog()->error("%s: Invalid geometry file.",
 			                              getName().c_str());
@@ -336,26 +454,6 @@ namespace scene
 			free(indexdata);
 			return false;
 		}
-		// Construct vertex/index buffers
-		res::ResourceManager *rmgr = getManager();
-		vertices = rmgr->createResource<render::VertexBuffer>("VertexBuffer");
-		indices = rmgr->createResource<render::IndexBuffer>("IndexBuffer");
-		if (!vertices || !indices)
-		{
-			getManager()->getLog()->error("%s: Could not create buffers.",
-			                              getName().c_str());
-			free(vertexdata);
-			free(indexdata);
-			return false;
-		}
-		vertices->set(header.vertexdatasize,
-		              vertexdata,
-		              render::VertexBufferUsage::Static,
-		              false);
-		indices->set(header.indexdatasize,
-		             indexdata,
-		             render::IndexBufferUsage::Static,
-		             false);
 		// Read batch info
 		std::vector<GeometryFile::Batch> batchdata(header.batchcount);
 		for (unsigned int i = 0; i < header.batchcount; i++)
@@ -367,8 +465,33 @@ namespace scene
 			{
 				getManager()->getLog()->error("%s: Could not read batch.",
 				                              getName().c_str());
+				free(vertexdata);
+				free(indexdata);
 				return false;
 			}
+			// Bounding box
+			float *boundingbox = batchdata[i].boundingbox;
+			if (header.version >= 1)
+			{
+				int boxsize = sizeof(float) * 6;
+				if (file->read(boxsize, boundingbox) != boxsize)
+				{
+					getManager()->getLog()->error("%s: Could not read bounding box.",
+					                              getName().c_str());
+					free(vertexdata);
+					free(indexdata);
+					return false;
+				}
+			}
+			else
+			{
+				// Older files do not contain bounding boxes
+				computeBoundingBox(attribs,
+				                   geom,
+				                   vertexdata,
+				                   header.vertexdatasize,
+				                   boundingbox);
+			}
 			// Joint matrices
 			if (geom.jointcount == 0)
 				continue;
@@ -378,9 +501,31 @@ namespace scene
 			{
 				getManager()->getLog()->error("%s: Could not read joint matrices.",
 				                              getName().c_str());
+				free(vertexdata);
+				free(indexdata);
 				return false;
 			}
 		}
+		// Construct vertex/index buffers
+		res::ResourceManager *rmgr = getManager();
+		vertices = rmgr->createResource<render::VertexBuffer>("VertexBuffer");
+		indices = rmgr->createResource<render::IndexBuffer>("IndexBuffer");
+		if (!vertices || !indices)
+		{
+			getManager()->getLog()->error("%s: Could not create buffers.",
+			                              getName().c_str());
+			free(vertexdata);
+			free(indexdata);
+			return false;
+		}
+		vertices->set(header.vertexdatasize,
+		              vertexdata,
+		              render::VertexBufferUsage::Static,
+		              false);
+		indices->set(header.indexdatasize,
+		             indexdata,
+		             render::IndexBufferUsage::Static,
+		             false);
 		// Construct geometry batch info
 		geometry.resize(header.batchcount);
 		for (unsigned int i = 0; i < header.batchcount; i++)
@@ -404,6 +549,14 @@ namespace scene
 			geometry[i].mesh->setVertexCount(geom.vertexsize / attribs.stride);
 			geometry[i].mesh->setVertexBuffer(vertices);
 			geometry[i].mesh->setIndexBuffer(indices);
+			// Bounding box (empty if the batch does not have any positions)
+			float *boundingbox = batchdata[i].boundingbox;
+			geometry[i].boundingbox.minCorner = math::Vec3f(boundingbox[0],
+			                                                boundingbox[1],
+			                                                boundingbox[2]);
+			geometry[i].boundingbox.maxCorner = math::Vec3f(boundingbox[3],
+			                                                boundingbox[4],
+			                                                boundingbox[5]);
 			// Create joints
 			geometry[i].joints.resize(batchdata[i].geom.jointcount);
 			for (unsigned int j = 0; j < batchdata[i].geom.jointcount; j++)
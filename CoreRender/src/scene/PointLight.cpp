@@ -58,18 +58,18 @@ namespace scene
 	{
 	}
 
-	void PointLight::getLightQuad(Camera::Ptr camera,
+	bool PointLight::getLightQuad(Camera::Ptr camera,
 	                              float *quad)
 	{
 		// To find out the bounds of the light quad in screen space, we need
 		// to transform the bounding box of the light
 		math::BoundingBox lightbb(getPosition() + math::Vec3f(-radius, -radius, -radius),
 		                          getPosition() + math::Vec3f(radius, radius, radius));
-		lightbb = lightbb.transform(camera->getViewMat()).transform(camera->getProjMat());
-		quad[0] = lightbb.minCorner.x;
-		quad[1] = lightbb.minCorner.y;
-		quad[2] = lightbb.maxCorner.x;
-		quad[3] = lightbb.maxCorner.y;
+		return getScreenRect(camera, lightbb, quad);
+	}
+	bool PointLight::isVisible(const render::Frustum &frustum)
+	{
+		return frustum.isSphereVisible(getPosition(), radius);
 	}
 
 	void PointLight::getLightInfo(render::LightUniforms *uniforms)
@@ -21,11 +21,14 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "CoreRender/scene/Scene.hpp"
 #include "CoreRender/render/FrameData.hpp"
+#include "CoreRender/render/OcclusionBuffer.hpp"
 #include "CoreRender/core/MemoryPool.hpp"
 #include "CoreRender/core/HashMap.hpp"
 #include "CoreRender/render/Material.hpp"
 #include "CoreRender/res/ResourceManager.hpp"
 
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <cstring>
 #include <iostream>
 
@@ -56,6 +59,18 @@ namespace scene
 	{
 		cameras.clear();
 		lights.clear();
+		for (unsigned int i = 0; i < models.size(); i++)
+		{
+			if (models[i].model)
+				modelindex.remove(models[i].leaf);
+		}
+		models.clear();
+		freemodels.clear();
+		occluders.clear();
+		freeoccluders.clear();
+		for (unsigned int i = 0; i < occlusionbuffers.size(); i++)
+			delete occlusionbuffers[i];
+		occlusionbuffers.clear();
 		shadowmap = 0;
 		shadowtarget = 0;
 	}
@@ -95,14 +110,214 @@ namespace scene
 		}
 	}
 
+	unsigned int Scene::addModel(Model::Ptr model,
+	                             const math::Mat4f &transmat,
+	                             const math::BoundingBox &bounds)
+	{
+		tbb::mutex::scoped_lock lock(modelmutex);
+		unsigned int handle;
+		if (!freemodels.empty())
+		{
+			handle = freemodels.back();
+			freemodels.pop_back();
+		}
+		else
+		{
+			handle = models.size();
+			models.push_back(ModelInstance());
+		}
+		ModelInstance &instance = models[handle];
+		instance.model = model;
+		instance.transmat = transmat;
+		instance.bounds = bounds;
+		instance.worldbounds = render::Frustum::transformBox(bounds, transmat);
+		instance.leaf = modelindex.insert(instance.worldbounds, handle);
+		return handle;
+	}
+	void Scene::setModelTransformation(unsigned int handle,
+	                                   const math::Mat4f &transmat)
+	{
+		tbb::mutex::scoped_lock lock(modelmutex);
+		if (handle >= models.size() || !models[handle].model)
+			return;
+		ModelInstance &instance = models[handle];
+		instance.transmat = transmat;
+		instance.worldbounds = render::Frustum::transformBox(instance.bounds, transmat);
+		modelindex.update(instance.leaf, instance.worldbounds);
+	}
+	void Scene::removeModel(unsigned int handle)
+	{
+		tbb::mutex::scoped_lock lock(modelmutex);
+		if (handle >= models.size() || !models[handle].model)
+			return;
+		modelindex.remove(models[handle].leaf);
+		models[handle].model = 0;
+		freemodels.push_back(handle);
+	}
+
+	unsigned int Scene::addOccluder(const float *positions,
+	                                unsigned int vertexcount,
+	                                const unsigned int *indices,
+	                                unsigned int indexcount,
+	                                const math::Mat4f &transmat)
+	{
+		tbb::mutex::scoped_lock lock(occludermutex);
+		unsigned int handle;
+		if (!freeoccluders.empty())
+		{
+			handle = freeoccluders.back();
+			freeoccluders.pop_back();
+		}
+		else
+		{
+			handle = occluders.size();
+			occluders.push_back(Occluder());
+		}
+		Occluder &occluder = occluders[handle];
+		occluder.positions.assign(positions, positions + vertexcount * 3);
+		occluder.indices.assign(indices, indices + indexcount);
+		occluder.transmat = transmat;
+		occluder.used = true;
+		// Compute the bounding box for frustum culling
+		math::BoundingBox bounds(math::Vec3f(0, 0, 0), math::Vec3f(0, 0, 0));
+		for (unsigned int i = 0; i < vertexcount; i++)
+		{
+			math::Vec3f pos(positions[i * 3],
+			                positions[i * 3 + 1],
+			                positions[i * 3 + 2]);
+			if (i == 0)
+				bounds = math::BoundingBox(pos, pos);
+			else
+				bounds = render::Frustum::mergeBoxes(bounds,
+				                                     math::BoundingBox(pos, pos));
+		}
+		occluder.worldbounds = render::Frustum::transformBox(bounds, transmat);
+		return handle;
+	}
+	void Scene::removeOccluder(unsigned int handle)
+	{
+		tbb::mutex::scoped_lock lock(occludermutex);
+		if (handle >= occluders.size() || !occluders[handle].used)
+			return;
+		Occluder &occluder = occluders[handle];
+		occluder.used = false;
+		occluder.positions.clear();
+		occluder.indices.clear();
+		freeoccluders.push_back(handle);
+	}
+
+	/**
+	 * Adds the model instances returned by the spatial index to a render
+	 * queue.
+	 */
+	class Scene::ModelCollector
+	{
+		public:
+			ModelCollector(render::RenderQueue &queue,
+			               std::vector<ModelInstance> &models)
+				: queue(queue), models(models), culled(0)
+			{
+			}
+
+			void operator()(unsigned int handle)
+			{
+				ModelInstance &instance = models[handle];
+				if (queue.occlusion
+				 && !queue.occlusion->isVisible(instance.worldbounds))
+					return;
+				if (queue.occlusionquery && !isQueryVisible(handle, instance))
+					return;
+				// The whole model already passed the occlusion test, so the
+				// batches do not have to be tested again
+				instance.model->render(queue, instance.transmat, false);
+			}
+
+			/**
+			 * Returns the number of instances which were skipped because
+			 * of the results of hardware occlusion queries.
+			 */
+			unsigned int getCulledCount()
+			{
+				return culled;
+			}
+		private:
+			bool isQueryVisible(unsigned int handle, ModelInstance &instance)
+			{
+				// Boxes which are clipped by the near plane might not
+				// produce any samples even though the camera is inside, so
+				// they are not queried
+				if (queue.clipping.intersectsNearPlane(instance.worldbounds))
+					return true;
+				render::OcclusionQuery *query = queue.occlusionquery;
+				bool visible = query->isVisible(handle);
+				if (!queue.requestqueries)
+					return visible;
+				if (query->needsQuery(handle))
+					query->addRequest(handle, instance.worldbounds);
+				if (!visible)
+					culled++;
+				return visible;
+			}
+
+			render::RenderQueue &queue;
+			std::vector<ModelInstance> &models;
+			unsigned int culled;
+	};
+	/**
+	 * Traverses the spatial index for a range of render queues.
+	 */
+	class Scene::QueueFiller
+	{
+		public:
+			QueueFiller(render::FrameData *frame,
+			            render::RenderQueue *queues,
+			            std::vector<ModelInstance> &models,
+			            const SpatialIndex &index)
+				: frame(frame), queues(queues), models(models), index(index)
+			{
+			}
+
+			void operator()(const tbb::blocked_range<unsigned int> &range) const
+			{
+				for (unsigned int i = range.begin(); i != range.end(); i++)
+				{
+					ModelCollector collector(queues[i], models);
+					index.query(queues[i].clipping, collector);
+					if (collector.getCulledCount() != 0)
+						frame->addOcclusionCulledCount(collector.getCulledCount());
+				}
+			}
+		private:
+			render::FrameData *frame;
+			render::RenderQueue *queues;
+			std::vector<ModelInstance> &models;
+			const SpatialIndex &index;
+	};
+
 	render::SceneFrameData *Scene::beginFrame(render::FrameData *frame)
 	{
+		// Apply the occlusion query results which have arrived since the
+		// last frame
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			render::OcclusionQuery::Ptr query = cameras[i]->getOcclusionQuery();
+			if (query)
+				query->update();
+		}
+		// Only lights which are visible need to be drawn, the same lights
+		// are used for counting and for filling the render queues
+		std::vector<std::vector<Light::Ptr> > visiblelights(cameras.size());
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			if (cameras[i]->getPipeline())
+				clipLights(cameras[i], visiblelights[i]);
+		}
 		// Compute the count of render queues
 		// We have to do this here before allocating the render queue list
 		unsigned int queuecount = 0;
 		for (unsigned int i = 0; i < cameras.size(); i++)
 		{
-			queuecount += getRenderQueueCount(cameras[i]);
+			queuecount += getRenderQueueCount(cameras[i], visiblelights[i]);
 		}
 		// Create render queues
 		core::MemoryPool *memory = frame->getMemory();
@@ -114,28 +329,59 @@ namespace scene
 			memory->registerDestructor(&queues[i]);
 		}
 		for (unsigned int i = 0; i < queuecount; i++)
-			queues[i].memory = memory;
+		{
+			queues[i].setMemory(memory);
+			queues[i].frameid = frame->getFrameId();
+		}
 		// Create scene frame data
 		void *allocated = memory->allocate(sizeof(render::SceneFrameData));
 		render::SceneFrameData *framedata = new(allocated) render::SceneFrameData(queues, queuecount);
 		// Initialize queues and pipeline commands
 		unsigned int currentqueue = 0;
+		std::vector<render::RenderCommand*> querycommands;
 		for (unsigned int i = 0; i < cameras.size(); i++)
 		{
-			currentqueue += beginFrame(framedata, &queues[currentqueue], cameras[i], memory);
+			const render::OcclusionBuffer *occlusion = 0;
+			if (cameras[i]->getPipeline())
+				occlusion = drawOccluders(i);
+			currentqueue += beginFrame(framedata,
+			                           &queues[currentqueue],
+			                           cameras[i],
+			                           visiblelights[i],
+			                           occlusion,
+			                           querycommands,
+			                           memory);
+		}
+		// Add the registered models to the queues, every queue is traversed
+		// by a different thread
+		{
+			tbb::mutex::scoped_lock lock(modelmutex);
+			if (modelindex.getObjectCount() != 0)
+			{
+				tbb::parallel_for(tbb::blocked_range<unsigned int>(0, queuecount),
+				                  QueueFiller(frame, queues, models, modelindex),
+				                  tbb::simple_partitioner());
+			}
+		}
+		// The occlusion query requests are only known after the queues have
+		// been filled
+		for (unsigned int i = 0; i < querycommands.size(); i++)
+		{
+			render::RenderCommand *cmd = querycommands[i];
+			render::OcclusionQuery *query = cmd->occlusionqueries.query;
+			cmd->occlusionqueries.requests = query->takeRequests(memory,
+			                                                     cmd->occlusionqueries.count);
 		}
 		frame->addScene(framedata);
 		return framedata;
 	}
 
-	unsigned int Scene::getRenderQueueCount(Camera::Ptr camera)
+	unsigned int Scene::getRenderQueueCount(Camera::Ptr camera,
+	                                        std::vector<Light::Ptr> &lights)
 	{
 		render::Pipeline::Ptr pipeline = camera->getPipeline();
 		if (!pipeline)
 			return 0;
-		// Only lights which are visible need to be drawn
-		std::vector<Light::Ptr> lights;
-		clipLights(camera, lights);
 		// We need the exact number of shadows/lights to be rendered for
 		// allocating render queues
 		unsigned int forwardlightcount, forwardshadowcount;
@@ -205,26 +451,76 @@ namespace scene
 	void Scene::clipLights(Camera::Ptr camera,
 	                       std::vector<Light::Ptr> &visible)
 	{
-		// TODO
-		visible = lights;
+		render::Frustum frustum;
+		frustum.setMatrix(camera->getProjMat() * camera->getViewMat());
+		visible.clear();
+		visible.reserve(lights.size());
+		for (unsigned int i = 0; i < lights.size(); i++)
+		{
+			// Lights outside of the view frustum or with an empty screen
+			// rectangle do not affect the image
+			if (!lights[i]->isVisible(frustum))
+				continue;
+			float quad[4];
+			if (!lights[i]->getLightQuad(camera, quad))
+				continue;
+			visible.push_back(lights[i]);
+		}
+	}
+	const render::OcclusionBuffer *Scene::drawOccluders(unsigned int cameraindex)
+	{
+		tbb::mutex::scoped_lock lock(occludermutex);
+		if (occluders.size() == freeoccluders.size())
+			return 0;
+		if (occlusionbuffers.size() < cameras.size())
+			occlusionbuffers.resize(cameras.size(), 0);
+		if (!occlusionbuffers[cameraindex])
+			occlusionbuffers[cameraindex] = new render::OcclusionBuffer;
+		render::OcclusionBuffer *buffer = occlusionbuffers[cameraindex];
+		Camera::Ptr camera = cameras[cameraindex];
+		math::Mat4f viewprojmat = camera->getProjMat() * camera->getViewMat();
+		render::Frustum frustum;
+		frustum.setMatrix(viewprojmat);
+		buffer->clear(viewprojmat);
+		for (unsigned int i = 0; i < occluders.size(); i++)
+		{
+			Occluder &occluder = occluders[i];
+			if (!occluder.used || occluder.indices.empty())
+				continue;
+			if (!frustum.isVisible(occluder.worldbounds, math::Mat4f::Identity()))
+				continue;
+			buffer->drawOccluder(&occluder.positions[0],
+			                     occluder.positions.size() / 3,
+			                     &occluder.indices[0],
+			                     occluder.indices.size(),
+			                     occluder.transmat);
+		}
+		if (!buffer->hasOccluders())
+			return 0;
+		buffer->buildHierarchy();
+		return buffer;
 	}
 	unsigned int Scene::beginFrame(render::SceneFrameData *frame,
 	                               render::RenderQueue *queue,
 	                               Camera::Ptr camera,
+	                               std::vector<Light::Ptr> &lights,
+	                               const render::OcclusionBuffer *occlusion,
+	                               std::vector<render::RenderCommand*> &querycommands,
 	                               core::MemoryPool *memory)
 	{
 		render::Pipeline::Ptr pipeline = camera->getPipeline();
 		if (!pipeline)
 			return 0;
+		render::OcclusionQuery *occlusionquery = camera->getOcclusionQuery().get();
+		bool requestqueries = occlusionquery != 0;
 		// Initialize camera uniforms
-		void *ptr = memory->allocate(sizeof(render::CameraUniforms));
+		void *ptr = memory->allocate(sizeof(render::CameraUniforms),
+		                             core::MemoryPool::SIMD_ALIGNMENT);
 		render::CameraUniforms *camerauniforms = (render::CameraUniforms*)ptr;
 		camerauniforms->projmat = camera->getProjMat();
 		camerauniforms->viewmat = camera->getViewMat();
 		camerauniforms->viewer = camera->getViewMat().inverse().transformPoint(math::Vec3f(0, 0, 0));
-		// Only lights which are visible need to be drawn
-		std::vector<Light::Ptr> lights;
-		clipLights(camera, lights);
+		math::Mat4f viewprojmat = camerauniforms->projmat * camerauniforms->viewmat;
 		unsigned int queuecount = 0;
 		std::vector<render::TextureBinding> boundtextures;
 		render::TextureBinding *preparedtextures = 0;
@@ -245,7 +541,11 @@ namespace scene
 					queue[queuecount].context = command->uintparams[0];
 					queue[queuecount].camera = camerauniforms;
 					queue[queuecount].light = 0;
-					// TODO: Clipping
+					queue[queuecount].sortmode = (render::SortMode::List)command->uintparams[1];
+					queue[queuecount].clipping.setMatrix(viewprojmat);
+					queue[queuecount].occlusion = occlusion;
+					queue[queuecount].occlusionquery = occlusionquery;
+					queue[queuecount].requestqueries = requestqueries;
 					// Add draw command to the queue
 					void *ptr = memory->allocate(sizeof(render::RenderCommand));
 					render::RenderCommand *cmd = (render::RenderCommand*)ptr;
@@ -253,6 +553,22 @@ namespace scene
 					cmd->renderqueue.queue = &queue[queuecount];
 					frame->addCommand(cmd);
 					queuecount++;
+					// The bounding boxes are queried against the depth buffer
+					// of the first geometry pass, the requests are filled in
+					// after the render queues
+					if (requestqueries)
+					{
+						ptr = memory->allocate(sizeof(render::RenderCommand));
+						cmd = (render::RenderCommand*)ptr;
+						cmd->type = render::RenderCommandType::OcclusionQueries;
+						cmd->occlusionqueries.query = occlusionquery;
+						cmd->occlusionqueries.requests = 0;
+						cmd->occlusionqueries.count = 0;
+						cmd->occlusionqueries.camera = camerauniforms;
+						frame->addCommand(cmd);
+						querycommands.push_back(cmd);
+						requestqueries = false;
+					}
 				}
 				else if (command->type == render::PipelineCommandType::DoForwardLightLoop)
 				{
@@ -298,7 +614,9 @@ namespace scene
 						queue[queuecount].context = lights[i]->getLightContext();
 						queue[queuecount].camera = camerauniforms;
 						queue[queuecount].light = light;
-						// TODO: Clipping
+						queue[queuecount].clipping.setMatrix(viewprojmat);
+						queue[queuecount].occlusion = occlusion;
+						queue[queuecount].occlusionquery = occlusionquery;
 						// Add draw command to the queue
 						ptr = memory->allocate(sizeof(render::RenderCommand));
 						render::RenderCommand *cmd = (render::RenderCommand*)ptr;
@@ -311,6 +629,12 @@ namespace scene
 				else if (command->type == render::PipelineCommandType::DoDeferredLightLoop)
 				{
 					prepareTextures(frame, boundtextures, preparedtextures, memory);
+					// Consecutive lights without shadows are drawn with one
+					// instanced draw call
+					render::QuadInstance *lightquads;
+					lightquads = memory->allocateArray<render::QuadInstance>(lights.size());
+					unsigned int lightquadcount = 0;
+					render::RenderCommand *lastquads = 0;
 					// Render all lights one by one (forward lighting)
 					for (unsigned int i = 0; i < lights.size(); i++)
 					{
@@ -324,6 +648,7 @@ namespace scene
 						if (lights[i]->getShadowsEnabled()
 							&& lights[i]->getShadowContext() != -1)
 						{
+							lastquads = 0;
 							light->shadowmap = shadowmap.get();
 							unsigned int shadowmapcount = lights[i]->getShadowMapCount();
 							insertSetTarget(frame, shadowtarget, camera, memory);
@@ -358,6 +683,43 @@ namespace scene
 						if (!comb)
 							continue;
 
+						// Instanced light quad - this changes the order of
+						// the lights, so only do this for additive blending
+						if (!light->shadowmap
+							&& comb->currentdata.blendmode == render::BlendMode::Add)
+						{
+							render::ShaderCombination::Ptr instancedcomb;
+							instancedcomb = shader->getCombination(context,
+							                                       0,
+							                                       0,
+							                                       true,
+							                                       false);
+							if (instancedcomb && instancedcomb->instancing)
+							{
+								render::QuadInstance *quad = &lightquads[lightquadcount];
+								lightquadcount++;
+								lights[i]->getLightQuad(camera, quad->quad);
+								quad->light = light;
+								if (lastquads
+									&& lastquads->drawquads.shader == instancedcomb.get()
+									&& lastquads->drawquads.material == material.get())
+								{
+									lastquads->drawquads.quadcount++;
+									continue;
+								}
+								ptr = memory->allocate(sizeof(render::RenderCommand));
+								render::RenderCommand *cmd = (render::RenderCommand*)ptr;
+								cmd->type = render::RenderCommandType::DrawQuads;
+								cmd->drawquads.quads = quad;
+								cmd->drawquads.quadcount = 1;
+								cmd->drawquads.material = material.get();
+								cmd->drawquads.shader = instancedcomb.get();
+								cmd->drawquads.camera = camerauniforms;
+								frame->addCommand(cmd);
+								lastquads = cmd;
+								continue;
+							}
+						}
 						// Light quad
 						ptr = memory->allocate(sizeof(render::RenderCommand));
 						render::RenderCommand *cmd = (render::RenderCommand*)ptr;
@@ -368,6 +730,7 @@ namespace scene
 						cmd->drawquad.camera = camerauniforms;
 						cmd->drawquad.light = light;
 						frame->addCommand(cmd);
+						lastquads = 0;
 					}
 				}
 				else if (command->type == render::PipelineCommandType::ClearTarget)
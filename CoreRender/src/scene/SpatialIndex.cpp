@@ -0,0 +1,285 @@
+/*
+Copyright (C) 2010, Mathias Gottschlag
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CoreRender/scene/SpatialIndex.hpp"
+
+#include <algorithm>
+
+namespace cr
+{
+namespace scene
+{
+	/**
+	 * Leaf boxes are enlarged by this fraction of their size in every
+	 * direction so that small movements do not require any refitting.
+	 */
+	static const float BOX_MARGIN = 0.1f;
+
+	SpatialIndex::SpatialIndex()
+		: root(-1), freelist(-1), objectcount(0)
+	{
+	}
+	SpatialIndex::~SpatialIndex()
+	{
+	}
+
+	int SpatialIndex::insert(const math::BoundingBox &box, unsigned int userdata)
+	{
+		int leaf = allocateNode();
+		nodes[leaf].box = enlarge(box);
+		nodes[leaf].userdata = userdata;
+		insertLeaf(leaf);
+		objectcount++;
+		return leaf;
+	}
+	void SpatialIndex::remove(int leaf)
+	{
+		removeLeaf(leaf);
+		freeNode(leaf);
+		objectcount--;
+	}
+	bool SpatialIndex::update(int leaf, const math::BoundingBox &box)
+	{
+		Node &node = nodes[leaf];
+		if (contains(node.box, box))
+			return false;
+		math::BoundingBox oldbox = node.box;
+		node.box = enlarge(box);
+		if (!overlaps(oldbox, box))
+		{
+			// The object moved to a different place, the old position in the
+			// tree probably is a bad fit
+			removeLeaf(leaf);
+			insertLeaf(leaf);
+		}
+		else
+		{
+			refit(node.parent);
+		}
+		return true;
+	}
+
+	int SpatialIndex::allocateNode()
+	{
+		int node;
+		if (freelist != -1)
+		{
+			node = freelist;
+			freelist = nodes[node].parent;
+		}
+		else
+		{
+			node = nodes.size();
+			nodes.push_back(Node());
+		}
+		nodes[node].parent = -1;
+		nodes[node].children[0] = -1;
+		nodes[node].children[1] = -1;
+		nodes[node].height = 0;
+		nodes[node].userdata = 0;
+		return node;
+	}
+	void SpatialIndex::freeNode(int node)
+	{
+		nodes[node].parent = freelist;
+		freelist = node;
+	}
+	void SpatialIndex::insertLeaf(int leaf)
+	{
+		if (root == -1)
+		{
+			root = leaf;
+			nodes[leaf].parent = -1;
+			return;
+		}
+		// Find the best sibling by descending into the child for which the
+		// increase of the surface area is smallest
+		math::BoundingBox leafbox = nodes[leaf].box;
+		int index = root;
+		while (!nodes[index].isLeaf())
+		{
+			const Node &node = nodes[index];
+			float area = getSurfaceArea(node.box);
+			float combinedarea = getSurfaceArea(render::Frustum::mergeBoxes(node.box,
+			                                                                leafbox));
+			// Cost of creating a new parent for this node and the leaf
+			float cost = 2.0f * combinedarea;
+			// Minimum cost of pushing the leaf further down the tree
+			float inheritancecost = 2.0f * (combinedarea - area);
+			float childcost[2];
+			for (unsigned int i = 0; i < 2; i++)
+			{
+				const Node &child = nodes[node.children[i]];
+				float childarea = getSurfaceArea(render::Frustum::mergeBoxes(child.box,
+				                                                             leafbox));
+				if (!child.isLeaf())
+					childarea -= getSurfaceArea(child.box);
+				childcost[i] = childarea + inheritancecost;
+			}
+			if (cost < childcost[0] && cost < childcost[1])
+				break;
+			index = childcost[0] < childcost[1] ? node.children[0] : node.children[1];
+		}
+		// Create a new parent for the sibling and the leaf
+		int sibling = index;
+		int oldparent = nodes[sibling].parent;
+		int newparent = allocateNode();
+		nodes[newparent].parent = oldparent;
+		nodes[newparent].box = render::Frustum::mergeBoxes(leafbox,
+		                                                   nodes[sibling].box);
+		nodes[newparent].children[0] = sibling;
+		nodes[newparent].children[1] = leaf;
+		nodes[newparent].height = nodes[sibling].height + 1;
+		nodes[sibling].parent = newparent;
+		nodes[leaf].parent = newparent;
+		if (oldparent == -1)
+		{
+			root = newparent;
+		}
+		else
+		{
+			if (nodes[oldparent].children[0] == sibling)
+				nodes[oldparent].children[0] = newparent;
+			else
+				nodes[oldparent].children[1] = newparent;
+		}
+		refit(oldparent);
+	}
+	void SpatialIndex::removeLeaf(int leaf)
+	{
+		if (leaf == root)
+		{
+			root = -1;
+			return;
+		}
+		// Replace the parent with the sibling of the leaf
+		int parent = nodes[leaf].parent;
+		int grandparent = nodes[parent].parent;
+		int sibling = nodes[parent].children[0] == leaf
+		            ? nodes[parent].children[1] : nodes[parent].children[0];
+		if (grandparent == -1)
+		{
+			root = sibling;
+			nodes[sibling].parent = -1;
+		}
+		else
+		{
+			if (nodes[grandparent].children[0] == parent)
+				nodes[grandparent].children[0] = sibling;
+			else
+				nodes[grandparent].children[1] = sibling;
+			nodes[sibling].parent = grandparent;
+			refit(grandparent);
+		}
+		freeNode(parent);
+		nodes[leaf].parent = -1;
+	}
+	void SpatialIndex::refit(int node)
+	{
+		while (node != -1)
+		{
+			node = balance(node);
+			Node &current = nodes[node];
+			const Node &left = nodes[current.children[0]];
+			const Node &right = nodes[current.children[1]];
+			current.box = render::Frustum::mergeBoxes(left.box, right.box);
+			current.height = 1 + std::max(left.height, right.height);
+			node = current.parent;
+		}
+	}
+	int SpatialIndex::balance(int node)
+	{
+		const Node &current = nodes[node];
+		if (current.isLeaf() || current.height < 2)
+			return node;
+		int difference = nodes[current.children[1]].height
+		               - nodes[current.children[0]].height;
+		if (difference > 1)
+			return rotate(node, 1);
+		if (difference < -1)
+			return rotate(node, 0);
+		return node;
+	}
+	int SpatialIndex::rotate(int node, unsigned int child)
+	{
+		// The higher child replaces the node, the node gets the lower
+		// grandchild in exchange
+		Node &current = nodes[node];
+		int up = current.children[child];
+		int other = current.children[1 - child];
+		Node &upper = nodes[up];
+		int larger = upper.children[0];
+		int smaller = upper.children[1];
+		if (nodes[larger].height < nodes[smaller].height)
+			std::swap(larger, smaller);
+		// Move the higher child up
+		upper.parent = current.parent;
+		if (upper.parent == -1)
+			root = up;
+		else if (nodes[upper.parent].children[0] == node)
+			nodes[upper.parent].children[0] = up;
+		else
+			nodes[upper.parent].children[1] = up;
+		upper.children[0] = node;
+		upper.children[1] = larger;
+		current.parent = up;
+		// The node keeps its other child and gets the lower grandchild
+		current.children[child] = smaller;
+		nodes[smaller].parent = node;
+		current.box = render::Frustum::mergeBoxes(nodes[other].box,
+		                                          nodes[smaller].box);
+		current.height = 1 + std::max(nodes[other].height,
+		                              nodes[smaller].height);
+		upper.box = render::Frustum::mergeBoxes(current.box,
+		                                        nodes[larger].box);
+		upper.height = 1 + std::max(current.height, nodes[larger].height);
+		return up;
+	}
+
+	math::BoundingBox SpatialIndex::enlarge(const math::BoundingBox &box)
+	{
+		math::Vec3f margin = (box.maxCorner - box.minCorner) * BOX_MARGIN;
+		return math::BoundingBox(box.minCorner - margin, box.maxCorner + margin);
+	}
+	bool SpatialIndex::contains(const math::BoundingBox &outer,
+	                            const math::BoundingBox &inner)
+	{
+		return outer.minCorner.x <= inner.minCorner.x
+		    && outer.minCorner.y <= inner.minCorner.y
+		    && outer.minCorner.z <= inner.minCorner.z
+		    && outer.maxCorner.x >= inner.maxCorner.x
+		    && outer.maxCorner.y >= inner.maxCorner.y
+		    && outer.maxCorner.z >= inner.maxCorner.z;
+	}
+	bool SpatialIndex::overlaps(const math::BoundingBox &a,
+	                            const math::BoundingBox &b)
+	{
+		return a.minCorner.x <= b.maxCorner.x && a.maxCorner.x >= b.minCorner.x
+		    && a.minCorner.y <= b.maxCorner.y && a.maxCorner.y >= b.minCorner.y
+		    && a.minCorner.z <= b.maxCorner.z && a.maxCorner.z >= b.minCorner.z;
+	}
+	float SpatialIndex::getSurfaceArea(const math::BoundingBox &box)
+	{
+		math::Vec3f size = box.maxCorner - box.minCorner;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+}
+}
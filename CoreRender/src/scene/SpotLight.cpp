@@ -25,6 +25,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/core/MemoryPool.hpp"
 
 #include <cstring>
+#include <cmath>
+#include <algorithm>
 
 namespace cr
 {
@@ -71,7 +73,8 @@ namespace scene
 		                      * math::Mat4f::TransMat(-getPosition());
 		*shadowmat = projmat * viewmat;
 		// Create render queue
-		void *ptr = queue->memory->allocate(sizeof(render::CameraUniforms));
+		void *ptr = queue->memory->allocate(sizeof(render::CameraUniforms),
+		                                    core::MemoryPool::SIMD_ALIGNMENT);
 		render::CameraUniforms *camerauniforms = (render::CameraUniforms*)ptr;
 		camerauniforms->projmat = projmat;
 		camerauniforms->viewmat = viewmat;
@@ -79,7 +82,7 @@ namespace scene
 		queue->context = getShadowContext();
 		queue->camera = camerauniforms;
 		queue->light = uniforms;
-		// TODO: Clipping
+		queue->clipping.setMatrix(*shadowmat);
 		// Add draw command to the queue
 		ptr = queue->memory->allocate(sizeof(render::RenderCommand));
 		render::RenderCommand *cmd = (render::RenderCommand*)ptr;
@@ -88,20 +91,67 @@ namespace scene
 		frame->addCommand(cmd);
 	}
 
-	void SpotLight::getLightQuad(Camera::Ptr camera,
+	bool SpotLight::getLightQuad(Camera::Ptr camera,
 	                             float *quad)
 	{
 		// To find out the bounds of the light quad in screen space, we need
 		// to transform the bounding box of the light
-		// TODO: This is way too much
 		math::BoundingBox lightbb(getPosition() + math::Vec3f(-radius, -radius, -radius),
 		                          getPosition() + math::Vec3f(radius, radius, radius));
-		lightbb.transform(camera->getViewMat());
-		lightbb.transform(camera->getProjMat());
-		quad[0] = lightbb.minCorner.x;
-		quad[1] = lightbb.minCorner.y;
-		quad[2] = lightbb.maxCorner.x;
-		quad[3] = lightbb.maxCorner.y;
+		math::Vec3f direction;
+		float height;
+		float baseradius;
+		if (getCone(direction, height, baseradius))
+		{
+			// The box of a narrow cone is the box containing the apex and
+			// the base circle
+			math::Vec3f apex = getPosition();
+			math::Vec3f basecenter = apex + direction * height;
+			math::Vec3f baseextents(baseradius * std::sqrt(std::max(0.0f, 1.0f - direction.x * direction.x)),
+			                        baseradius * std::sqrt(std::max(0.0f, 1.0f - direction.y * direction.y)),
+			                        baseradius * std::sqrt(std::max(0.0f, 1.0f - direction.z * direction.z)));
+			math::BoundingBox basebb(basecenter - baseextents,
+			                         basecenter + baseextents);
+			lightbb = render::Frustum::mergeBoxes(math::BoundingBox(apex, apex),
+			                                      basebb);
+		}
+		return getScreenRect(camera, lightbb, quad);
+	}
+	bool SpotLight::isVisible(const render::Frustum &frustum)
+	{
+		if (!frustum.isSphereVisible(getPosition(), radius))
+			return false;
+		math::Vec3f direction;
+		float height;
+		float baseradius;
+		if (!getCone(direction, height, baseradius))
+			return true;
+		return frustum.isConeVisible(getPosition(),
+		                             direction,
+		                             height,
+		                             baseradius);
+	}
+
+	bool SpotLight::getCone(math::Vec3f &direction,
+	                        float &height,
+	                        float &baseradius)
+	{
+		// Wide cones are better approximated by the sphere around the light
+		float halfangle = math::Math::degToRad(angle * 0.5f);
+		if (halfangle > math::Math::degToRad(60.0f))
+			return false;
+		direction = getDirection();
+		float length = std::sqrt(direction.x * direction.x
+		                       + direction.y * direction.y
+		                       + direction.z * direction.z);
+		if (length == 0.0f)
+			return false;
+		direction = direction * (1.0f / length);
+		// The cone has to contain the spherical cap at the end of the light
+		// volume
+		height = radius;
+		baseradius = radius * std::tan(halfangle);
+		return true;
 	}
 
 	void SpotLight::getLightInfo(render::LightUniforms *uniforms)
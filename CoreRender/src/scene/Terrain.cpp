@@ -26,11 +26,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CoreRender/GraphicsEngine.hpp"
 
 #include <cstring>
+#include <algorithm>
 
 namespace cr
 {
 namespace scene
 {
+	/**
+	 * Distance by which the terrain shaders move the skirt vertices below
+	 * the terrain surface.
+	 */
+	static const float SKIRT_DEPTH = 0.1f;
+
 	Terrain::Terrain(GraphicsEngine *graphics, const std::string& name)
 		: Resource(graphics->getResourceManager(), name), graphics(graphics),
 		displacement(0), normals(0), sizex(0), sizez(0), patchsize(0)
@@ -43,6 +50,9 @@ namespace scene
 		displacementmap = getManager()->createResource<render::Texture>("Texture");
 		displacementmap->setMipmapsEnabled(false);
 		displacementmap->setFiltering(render::TextureFiltering::Nearest);
+		res::NameRegistry &names = getManager()->getNameRegistry();
+		offsetscalename = names.getUniform("terrainOffsetScale");
+		texcoordscalename = names.getUniform("texCoordOffsetScale");
 		/*normalmap = rmgr->createResource<render::Texture>("Texture");
 		normalmap->setMipmapsEnabled(false);*/
 	}
@@ -61,8 +71,6 @@ namespace scene
 		// Allocate global uniforms
 		core::MemoryPool *memory = queue.memory;
 		render::CustomUniform texcoordscale;
-		char *uniformname = (char*)memory->allocate(strlen("texCoordOffsetScale") + 1);
-		strcpy(uniformname, "texCoordOffsetScale");
 		float *uniformdata = (float*)memory->allocate(sizeof(float) * 4);
 		// The texture coordinate 0 is not at the center, but at the edge of the
 		// first texel, same applies to the last texel in a row/column, so we
@@ -71,7 +79,7 @@ namespace scene
 		uniformdata[1] = 0.5f / sizez;
 		uniformdata[2] = (float)(sizex - 1) / sizex;
 		uniformdata[3] = (float)(sizez - 1) / sizez;
-		texcoordscale.name = uniformname;
+		texcoordscale.name = texcoordscalename;
 		texcoordscale.size = 4;
 		texcoordscale.data = uniformdata;
 		// For calculating the LODs we need the camera position in the local
@@ -85,6 +93,10 @@ namespace scene
 		renderRecursively(queue,
 		                  transmat,
 		                  maxdepth,
+		                  0,
+		                  0,
+		                  0,
+		                  render::Frustum::ALL_PLANES,
 		                  localcamerapos,
 		                  offsetscale,
 		                  texcoordscale);
@@ -164,6 +176,8 @@ namespace scene
 		// Update index/vertex buffers
 		// This only has to be done if the patch size changed
 		updateGeometry(patchsize);
+		// Compute the bounding boxes for frustum culling
+		updateBounds();
 		// Compute LOD offsets
 		// TODO
 	}
@@ -486,13 +500,76 @@ namespace scene
 		             false);
 	}
 
+	void Terrain::updateBounds()
+	{
+		unsigned int maxdepth = math::Math::log2((sizex - 1) / (patchsize - 1));
+		nodebounds.resize(getNodeIndex(maxdepth + 1, 0, 0));
+		// The leaves get the range of the displacement of all texels they
+		// cover, including the texels shared with the neighbouring leaves
+		unsigned int leafcount = 1 << maxdepth;
+		unsigned int leafsize = (sizex - 1) / leafcount;
+		float gridscale = 1.0f / (sizex - 1);
+		for (unsigned int z = 0; z < leafcount; z++)
+		{
+			for (unsigned int x = 0; x < leafcount; x++)
+			{
+				const float *first = &displacement[(z * leafsize * sizex + x * leafsize) * 4];
+				math::Vec3f mindisp(first[0], first[1], first[2]);
+				math::Vec3f maxdisp = mindisp;
+				for (unsigned int j = z * leafsize; j <= (z + 1) * leafsize; j++)
+				{
+					for (unsigned int i = x * leafsize; i <= (x + 1) * leafsize; i++)
+					{
+						const float *texel = &displacement[(j * sizex + i) * 4];
+						mindisp.x = std::min(mindisp.x, texel[0]);
+						mindisp.y = std::min(mindisp.y, texel[1]);
+						mindisp.z = std::min(mindisp.z, texel[2]);
+						maxdisp.x = std::max(maxdisp.x, texel[0]);
+						maxdisp.y = std::max(maxdisp.y, texel[1]);
+						maxdisp.z = std::max(maxdisp.z, texel[2]);
+					}
+				}
+				math::Vec3f minpos(x * leafsize * gridscale + mindisp.x,
+				                   mindisp.y - SKIRT_DEPTH,
+				                   z * leafsize * gridscale + mindisp.z);
+				math::Vec3f maxpos((x + 1) * leafsize * gridscale + maxdisp.x,
+				                   maxdisp.y,
+				                   (z + 1) * leafsize * gridscale + maxdisp.z);
+				nodebounds[getNodeIndex(maxdepth, x, z)] = math::BoundingBox(minpos, maxpos);
+			}
+		}
+		// Every other node contains its four children
+		for (int depth = maxdepth - 1; depth >= 0; depth--)
+		{
+			unsigned int nodecount = 1 << depth;
+			for (unsigned int z = 0; z < nodecount; z++)
+			{
+				for (unsigned int x = 0; x < nodecount; x++)
+				{
+					math::BoundingBox box;
+					box = render::Frustum::mergeBoxes(nodebounds[getNodeIndex(depth + 1, x * 2, z * 2)],
+					                                  nodebounds[getNodeIndex(depth + 1, x * 2 + 1, z * 2)]);
+					box = render::Frustum::mergeBoxes(box,
+					                                  nodebounds[getNodeIndex(depth + 1, x * 2, z * 2 + 1)]);
+					box = render::Frustum::mergeBoxes(box,
+					                                  nodebounds[getNodeIndex(depth + 1, x * 2 + 1, z * 2 + 1)]);
+					nodebounds[getNodeIndex(depth, x, z)] = box;
+				}
+			}
+		}
+	}
+
 	void Terrain::renderPatch(render::RenderQueue &queue,
 	                          math::Mat4f transmat,
 	                          unsigned int lod,
 	                          float *offsetscale,
 	                          render::CustomUniform &texcoordscale)
 	{
-		render::Batch *batch = queue.prepareBatch(material.get(), patches[lod].mesh.get(), false, false);
+		render::Batch *batch = queue.prepareBatch(material.get(),
+		                                          patches[lod].mesh.get(),
+		                                          transmat,
+		                                          false,
+		                                          false);
 		if (!batch)
 			return;
 		// TODO: This overwrites existing material uniforms
@@ -500,29 +577,37 @@ namespace scene
 		batch->customuniformcount = 2;
 		void *ptr = memory->allocate(sizeof(render::CustomUniform) * 2);
 		render::CustomUniform *uniform = (render::CustomUniform*)ptr;
-		char *uniformname = (char*)memory->allocate(strlen("terrainOffsetScale") + 1);
-		strcpy(uniformname, "terrainOffsetScale");
 		float *uniformdata = (float*)memory->allocate(sizeof(float) * 4);
 		memcpy(uniformdata, offsetscale, sizeof(float) * 4);
-		uniform[0].name = uniformname;
+		uniform[0].name = offsetscalename;
 		uniform[0].size = 4;
 		uniform[0].data = uniformdata;
 		uniform[1] = texcoordscale;
 		batch->customuniforms = uniform;
-		batch->transmat = transmat;
 		// Add batch to the render queuemesh
-		tbb::mutex::scoped_lock lock(queue.batchmutex);
-		queue.batches.push_back(batch);
+		queue.addBatch(batch);
 	}
 
 	void Terrain::renderRecursively(render::RenderQueue &queue,
 	                                math::Mat4f transmat,
 	                                unsigned int maxdepth,
+	                                unsigned int depth,
+	                                unsigned int nodex,
+	                                unsigned int nodez,
+	                                unsigned int planemask,
 	                                math::Vec3f camerapos,
 	                                float *offsetscale,
 	                                render::CustomUniform &texcoordscale)
 	{
-		// TODO: Clipping
+		// Nodes outside of the frustum are skipped together with all their
+		// children, nodes completely inside need no further tests
+		if (planemask != 0)
+		{
+			const math::BoundingBox &localbox = nodebounds[getNodeIndex(depth, nodex, nodez)];
+			math::BoundingBox box = render::Frustum::transformBox(localbox, transmat);
+			if (!queue.clipping.isVisible(box, planemask))
+				return;
+		}
 		math::Vec2f center(offsetscale[0] + offsetscale[2] * 0.5f,
 		                   offsetscale[1] + offsetscale[3] * 0.5f);
 		float cameradist = (center - math::Vec2f(camerapos.x, camerapos.z)).getLength();
@@ -556,13 +641,17 @@ namespace scene
 				offsetscale[2] * 0.5f,
 				offsetscale[3] * 0.5f
 			};
-			renderRecursively(queue, transmat, maxdepth - 1, camerapos,
+			renderRecursively(queue, transmat, maxdepth - 1, depth + 1,
+				nodex * 2, nodez * 2, planemask, camerapos,
 				offsetscale1, texcoordscale);
-			renderRecursively(queue, transmat, maxdepth - 1, camerapos,
+			renderRecursively(queue, transmat, maxdepth - 1, depth + 1,
+				nodex * 2 + 1, nodez * 2, planemask, camerapos,
 				offsetscale2, texcoordscale);
-			renderRecursively(queue, transmat, maxdepth - 1, camerapos,
+			renderRecursively(queue, transmat, maxdepth - 1, depth + 1,
+				nodex * 2, nodez * 2 + 1, planemask, camerapos,
 				offsetscale3, texcoordscale);
-			renderRecursively(queue, transmat, maxdepth - 1, camerapos,
+			renderRecursively(queue, transmat, maxdepth - 1, depth + 1,
+				nodex * 2 + 1, nodez * 2 + 1, planemask, camerapos,
 				offsetscale4, texcoordscale);
 		}
 		else
@@ -97,6 +97,8 @@ namespace rocket
 			};
 
 			std::vector<RenderEntry> renderentries;
+
+			unsigned int translationname;
 	};
 }
 }
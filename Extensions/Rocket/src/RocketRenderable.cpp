@@ -38,6 +38,8 @@ namespace rocket
 		                                      texturematerial,
 		                                      colormaterial);
 		renderinterface->AddReference();
+		res::NameRegistry &names = graphics->getResourceManager()->getNameRegistry();
+		translationname = names.getUniform("translation");
 	}
 	RocketRenderable::~RocketRenderable()
 	{
@@ -70,33 +72,32 @@ namespace rocket
 		// Render meshes
 		for (unsigned int i = 0; i < renderentries.size(); i++)
 		{
+			// Note that the render queue should use SortMode::None so that the
+			// batches are drawn in the order in which they are submitted
 			render::Batch *batch = queue.prepareBatch(renderentries[i].material.get(),
 		                                              renderentries[i].mesh.get(),
+		                                              transmat,
 		                                              false,
 		                                              false);
 			if (!batch)
 				continue;
-			batch->transmat = transmat;
 			// Translation
 			// TODO: This overwrites existing material uniforms
 			//std::cout << "translation: " << renderentries[i].translation.x << "/" << renderentries[i].translation.y << std::endl;
 			batch->customuniformcount = 1;
 			void *ptr = memory->allocate(sizeof(render::CustomUniform));
 			render::CustomUniform *uniform = (render::CustomUniform*)ptr;
-			char *uniformname = (char*)memory->allocate(strlen("translation") + 1);
-			strcpy(uniformname, "translation");
 			float *uniformdata = (float*)memory->allocate(sizeof(float) * 2);
 			uniformdata[0] = renderentries[i].translation.x;
 			uniformdata[1] = renderentries[i].translation.y;
-			uniform->name = uniformname;
+			uniform->name = translationname;
 			uniform->size = 2;
 			uniform->data = uniformdata;
 			batch->customuniforms = uniform;
 			if (renderentries[i].scissor != -1)
 				batch->scissor = &scissorrects[renderentries[i].scissor];
 			// Add batch to the render queue
-			tbb::mutex::scoped_lock lock(queue.batchmutex);
-			queue.batches.push_back(batch);
+			queue.addBatch(batch);
 		}
 	}
 
@@ -0,0 +1,96 @@
+#include "CoreRender/render/Frustum.hpp"
+#include "CoreRender/core/Time.hpp"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+using namespace cr;
+using namespace core;
+
+static unsigned int runBenchmark(unsigned int instancecount)
+{
+	static const unsigned int FRAMES = 100;
+	unsigned int errorcount = 0;
+	// Orthographic frustum containing the cube from (-100, -100, -100) to
+	// (100, 100, 100)
+	render::Frustum frustum;
+	frustum.setMatrix(math::Mat4f::ScaleMat(0.01f, 0.01f, 0.01f));
+	math::BoundingBox box(math::Vec3f(-1.0f, -1.0f, -1.0f),
+	                      math::Vec3f(1.0f, 1.0f, 1.0f));
+	// Scatter the instances around the frustum so that roughly one eighth
+	// of them is visible
+	std::vector<math::Mat4f> instances(instancecount);
+	std::srand(42);
+	for (unsigned int i = 0; i < instancecount; i++)
+	{
+		float x = (float)(std::rand() % 400) - 200.0f;
+		float y = (float)(std::rand() % 400) - 200.0f;
+		float z = (float)(std::rand() % 400) - 200.0f;
+		instances[i] = math::Mat4f::TransMat(x, y, z)
+		             * math::Mat4f::ScaleMat(2.0f, 2.0f, 2.0f);
+	}
+	// The results have to match the single instance test
+	std::vector<math::Mat4f> expected;
+	for (unsigned int i = 0; i < instancecount; i++)
+	{
+		if (frustum.isVisible(box, instances[i]))
+			expected.push_back(instances[i]);
+	}
+	std::vector<math::Mat4f> visible(instancecount);
+	unsigned int visiblecount = frustum.cullInstances(box,
+	                                                  &instances[0],
+	                                                  instancecount,
+	                                                  &visible[0]);
+	if (visiblecount != expected.size())
+	{
+		std::cout << visiblecount << " instances visible, expected "
+			<< expected.size() << "." << std::endl;
+		errorcount++;
+	}
+	else
+	{
+		for (unsigned int i = 0; i < visiblecount; i++)
+		{
+			if (memcmp(visible[i].m, expected[i].m, sizeof(visible[i].m)))
+			{
+				std::cout << "Visible instance " << i << " is wrong."
+					<< std::endl;
+				errorcount++;
+				break;
+			}
+		}
+	}
+	// Measure the time needed to cull all instances
+	Duration totaltime = Duration::Nanoseconds(0);
+	for (unsigned int frame = 0; frame < FRAMES; frame++)
+	{
+		Time start = Time::Now();
+		visiblecount = frustum.cullInstances(box,
+		                                     &instances[0],
+		                                     instancecount,
+		                                     &visible[0]);
+		Time end = Time::Now();
+		totaltime += end - start;
+	}
+	double milliseconds = totaltime.getNanoseconds() * 1.0e-6;
+	double culledcount = (double)instancecount * FRAMES;
+	std::cout << instancecount << " instances (" << visiblecount
+		<< " visible): " << milliseconds << " ms, "
+		<< culledcount / milliseconds << " instances/ms." << std::endl;
+	return errorcount;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int instancecount = 100000;
+	if (argc > 1)
+		instancecount = std::atoi(argv[1]);
+	unsigned int errorcount = 0;
+	// Also test a count which is not a multiple of four
+	errorcount += runBenchmark(instancecount);
+	errorcount += runBenchmark(instancecount + 3);
+	std::cout << errorcount << " errors." << std::endl;
+	return errorcount;
+}
@@ -47,6 +47,7 @@ int main(int argc, char **argv)
 {
 	static const unsigned int TEST_RUNS = 500000;
 	MemoryPool memory;
+	unsigned int wrongstats = 0;
 	for (unsigned int i = 0; i < 2; i++)
 	{
 		// Create a million instances of TestClass
@@ -55,9 +56,81 @@ int main(int argc, char **argv)
 			void *ptr = memory.allocate<TestClass>();
 			TestClass *obj = new(ptr) TestClass;
 		}
+		// Check the pool statistics
+		MemoryPoolStats stats;
+		memory.getStats(stats);
+		if (stats.destructors != TEST_RUNS)
+			wrongstats++;
+		if (stats.allocated < TEST_RUNS * sizeof(TestClass))
+			wrongstats++;
+		if (stats.usedpages * stats.pagesize < stats.allocated + stats.wasted)
+			wrongstats++;
 		// Release memory again
 		memory.reset();
 	}
+	// In thread-local mode the unused rest of the chunk of a thread counts as
+	// wasted memory
+	MemoryPool threadlocal(1048576, true);
+	threadlocal.allocate(64);
+	MemoryPoolStats threadstats;
+	threadlocal.getStats(threadstats);
+	if (threadstats.allocated + threadstats.wasted != threadstats.pagesize / 16)
+		wrongstats++;
+	// Check alignment of allocations, including allocations which do not fit
+	// into a single page
+	unsigned int misaligned = 0;
+	MemoryPool smallpages(4096);
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		for (unsigned int j = 0; j < 1000; j++)
+		{
+			unsigned int alignment = 1 << (j % 7);
+			unsigned int size = (j % 13 == 0) ? 10000 + j : j % 100 + 1;
+			char *ptr = (char*)smallpages.allocate(size, alignment);
+			if ((size_t)ptr & (alignment - 1))
+				misaligned++;
+			// Touch the memory so that overruns show up in memory checkers
+			ptr[0] = 1;
+			ptr[size - 1] = 1;
+			double *array = smallpages.allocateArray<double>(j % 50 + 1);
+			if ((size_t)array & (sizeof(double) - 1))
+				misaligned++;
+			float *simd = smallpages.allocateArray<float>(16,
+			                          MemoryPool::SIMD_ALIGNMENT);
+			if ((size_t)simd & (MemoryPool::SIMD_ALIGNMENT - 1))
+				misaligned++;
+		}
+		smallpages.reset();
+	}
+	// Allocations which do not fit into a page are reused after reset()
+	unsigned int largereused = 0;
+	void *large = smallpages.allocate(20000);
+	for (unsigned int i = 0; i < 10; i++)
+	{
+		smallpages.reset();
+		void *reused = smallpages.allocate(12000);
+		if (reused == large)
+			largereused++;
+		large = reused;
+	}
+	// Check that pages backed by huge pages are usable
+	MemoryPool hugepages(4 * MemoryPool::HUGE_PAGE_SIZE,
+	                     false,
+	                     MemoryPool::PageFlags::HugePages
+	                     | MemoryPool::PageFlags::Prefault);
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		for (unsigned int j = 0; j < 64; j++)
+		{
+			char *ptr = (char*)hugepages.allocate(1048576);
+			for (unsigned int k = 0; k < 1048576; k += 4096)
+				ptr[k] = 1;
+		}
+		hugepages.reset(16 * MemoryPool::HUGE_PAGE_SIZE);
+	}
+	std::cout << "Huge pages: " << hugepages.getHugePageCount()
+		<< " reserved, " << hugepages.getAdvisedHugePageCount()
+		<< " transparent." << std::endl;
 	// Check call numbers
 	unsigned int constructorcalls;
 	unsigned int wrongdata;
@@ -82,6 +155,23 @@ int main(int argc, char **argv)
 			<< std::endl;
 		errorcount++;
 	}
+	if (wrongstats != 0)
+	{
+		std::cout << wrongstats << " wrong pool statistics." << std::endl;
+		errorcount++;
+	}
+	if (largereused != 10)
+	{
+		std::cout << "Large allocations were reused " << largereused
+			<< " of 10 times." << std::endl;
+		errorcount++;
+	}
+	if (misaligned != 0)
+	{
+		std::cout << misaligned << " allocations were not aligned properly."
+			<< std::endl;
+		errorcount++;
+	}
 	std::cout << errorcount << " errors." << std::endl;
 	return errorcount;
 }
@@ -0,0 +1,129 @@
+#include "CoreRender/core/MemoryPool.hpp"
+#include "CoreRender/core/Thread.hpp"
+#include "CoreRender/core/Time.hpp"
+
+#include <tbb/atomic.h>
+#include <iostream>
+#include <cstdlib>
+
+using namespace cr;
+using namespace core;
+
+static tbb::atomic<unsigned int> destructorcalls;
+
+class TestObject
+{
+	public:
+		~TestObject()
+		{
+			destructorcalls++;
+		}
+	private:
+		// Roughly the size of a render::Batch
+		float data[24];
+};
+
+class Worker
+{
+	public:
+		Worker()
+			: memory(0), allocations(0), destructors(0), wrongdata(0)
+		{
+		}
+
+		void run()
+		{
+			unsigned int *previous = 0;
+			for (unsigned int i = 0; i < allocations; i++)
+			{
+				// Allocate memory and write into it to catch overlapping
+				// allocations from other threads
+				unsigned int *data = (unsigned int*)memory->allocate(64);
+				data[0] = i;
+				data[15] = i;
+				if (previous && (previous[0] != i - 1 || previous[15] != i - 1))
+					wrongdata++;
+				previous = data;
+				if (i % 16 == 0 && destructors > 0)
+				{
+					void *ptr = memory->allocate<TestObject>();
+					new(ptr) TestObject;
+					destructors--;
+				}
+			}
+		}
+
+		MemoryPool *memory;
+		unsigned int allocations;
+		unsigned int destructors;
+		unsigned int wrongdata;
+};
+
+static unsigned int runBenchmark(bool threadlocal,
+                                 unsigned int threadcount,
+                                 unsigned int allocations)
+{
+	static const unsigned int FRAMES = 10;
+	unsigned int errorcount = 0;
+	MemoryPool memory(1048576, threadlocal);
+	Duration totaltime = Duration::Nanoseconds(0);
+	for (unsigned int frame = 0; frame < FRAMES; frame++)
+	{
+		destructorcalls = 0;
+		unsigned int destructors = allocations / 16;
+		Worker *workers = new Worker[threadcount];
+		Thread *threads = new Thread[threadcount];
+		Time start = Time::Now();
+		for (unsigned int i = 0; i < threadcount; i++)
+		{
+			workers[i].memory = &memory;
+			workers[i].allocations = allocations;
+			workers[i].destructors = destructors;
+			threads[i].create(new ClassFunctor<Worker>(&workers[i], &Worker::run));
+		}
+		for (unsigned int i = 0; i < threadcount; i++)
+			threads[i].wait();
+		Time end = Time::Now();
+		totaltime += end - start;
+		for (unsigned int i = 0; i < threadcount; i++)
+		{
+			if (workers[i].wrongdata != 0)
+			{
+				std::cout << workers[i].wrongdata
+					<< " allocations were overwritten by another thread."
+					<< std::endl;
+				errorcount++;
+			}
+		}
+		delete[] threads;
+		delete[] workers;
+		// Release memory again, this has to call all destructors
+		memory.reset();
+		if (destructorcalls != destructors * threadcount)
+		{
+			std::cout << "Destructor called " << destructorcalls
+				<< " times, expected " << destructors * threadcount << "."
+				<< std::endl;
+			errorcount++;
+		}
+	}
+	double milliseconds = totaltime.getNanoseconds() * 1.0e-6;
+	double allocationcount = (double)allocations * threadcount * FRAMES;
+	std::cout << (threadlocal ? "Thread-local" : "Shared") << " pool, "
+		<< threadcount << " threads: " << milliseconds << " ms, "
+		<< allocationcount / milliseconds << " allocations/ms." << std::endl;
+	return errorcount;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int threadcount = 8;
+	if (argc > 1)
+		threadcount = std::atoi(argv[1]);
+	static const unsigned int ALLOCATIONS = 200000;
+	unsigned int errorcount = 0;
+	errorcount += runBenchmark(false, threadcount, ALLOCATIONS);
+	errorcount += runBenchmark(true, threadcount, ALLOCATIONS);
+	std::cout << errorcount << " errors." << std::endl;
+	return errorcount;
+}
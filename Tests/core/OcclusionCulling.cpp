@@ -0,0 +1,220 @@
+#include "CoreRender/render/OcclusionBuffer.hpp"
+#include "CoreRender/core/Time.hpp"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+using namespace cr;
+using namespace core;
+
+static const float BLOCK_SIZE = 24.0f;
+static const float BUILDING_SIZE = 16.0f;
+static const int CITY_RADIUS = 10;
+
+static math::Mat4f getPerspective(float fov, float aspect, float near, float far)
+{
+	math::Mat4f projmat = math::Mat4f::Identity();
+	float f = 1.0f / std::tan(fov * 3.14159265f / 360.0f);
+	projmat.m[0] = f / aspect;
+	projmat.m[5] = f;
+	projmat.m[10] = (far + near) / (near - far);
+	projmat.m[11] = -1.0f;
+	projmat.m[14] = 2.0f * far * near / (near - far);
+	projmat.m[15] = 0.0f;
+	return projmat;
+}
+
+static bool intersectsBox(const math::Vec3f &start,
+                          const math::Vec3f &end,
+                          const math::BoundingBox &box)
+{
+	// Slab test of the segment from start to end
+	float tmin = 0.0f;
+	float tmax = 1.0f;
+	float origin[3] = {start.x, start.y, start.z};
+	float direction[3] = {end.x - start.x, end.y - start.y, end.z - start.z};
+	float boxmin[3] = {box.minCorner.x, box.minCorner.y, box.minCorner.z};
+	float boxmax[3] = {box.maxCorner.x, box.maxCorner.y, box.maxCorner.z};
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		if (std::fabs(direction[i]) < 1.0e-6f)
+		{
+			if (origin[i] < boxmin[i] || origin[i] > boxmax[i])
+				return false;
+			continue;
+		}
+		float t0 = (boxmin[i] - origin[i]) / direction[i];
+		float t1 = (boxmax[i] - origin[i]) / direction[i];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		tmin = std::max(tmin, t0);
+		tmax = std::min(tmax, t1);
+		if (tmin > tmax)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned int FRAMES = 20;
+	unsigned int objectcount = 100000;
+	if (argc > 1)
+		objectcount = std::atoi(argv[1]);
+	unsigned int errorcount = 0;
+	std::srand(42);
+	// Synthetic city: a grid of buildings with streets in between, the
+	// camera stands at street level at an intersection
+	std::vector<math::BoundingBox> buildings;
+	for (int x = -CITY_RADIUS; x < CITY_RADIUS; x++)
+	{
+		for (int z = -CITY_RADIUS; z < CITY_RADIUS; z++)
+		{
+			float height = 10.0f + std::rand() % 30;
+			math::Vec3f corner(x * BLOCK_SIZE + (BLOCK_SIZE - BUILDING_SIZE) * 0.5f,
+			                   0.0f,
+			                   z * BLOCK_SIZE + (BLOCK_SIZE - BUILDING_SIZE) * 0.5f);
+			buildings.push_back(math::BoundingBox(corner,
+			                                      corner + math::Vec3f(BUILDING_SIZE,
+			                                                           height,
+			                                                           BUILDING_SIZE)));
+		}
+	}
+	// Unit cube used as occluder mesh for all buildings
+	float positions[24];
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		positions[i * 3] = (i & 1) ? 1.0f : 0.0f;
+		positions[i * 3 + 1] = (i & 2) ? 1.0f : 0.0f;
+		positions[i * 3 + 2] = (i & 4) ? 1.0f : 0.0f;
+	}
+	unsigned int indices[36] = {
+		0, 2, 1, 1, 2, 3,
+		4, 5, 6, 5, 7, 6,
+		0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7,
+		0, 4, 2, 2, 4, 6,
+		1, 3, 5, 3, 7, 5
+	};
+	std::vector<math::Mat4f> occludermatrices;
+	for (unsigned int i = 0; i < buildings.size(); i++)
+	{
+		math::Vec3f size = buildings[i].maxCorner - buildings[i].minCorner;
+		occludermatrices.push_back(math::Mat4f::TransMat(buildings[i].minCorner)
+		                         * math::Mat4f::ScaleMat(size));
+	}
+	// Small objects (cars, props) on the streets and on the roofs
+	std::vector<math::BoundingBox> objects;
+	float citysize = CITY_RADIUS * BLOCK_SIZE;
+	for (unsigned int i = 0; i < objectcount; i++)
+	{
+		math::Vec3f position((float)(std::rand() % 20000) / 10000.0f * citysize - citysize,
+		                     0.0f,
+		                     (float)(std::rand() % 20000) / 10000.0f * citysize - citysize);
+		for (unsigned int j = 0; j < buildings.size(); j++)
+		{
+			const math::BoundingBox &building = buildings[j];
+			if (position.x >= building.minCorner.x && position.x <= building.maxCorner.x
+			 && position.z >= building.minCorner.z && position.z <= building.maxCorner.z)
+			{
+				position.y = building.maxCorner.y;
+				break;
+			}
+		}
+		objects.push_back(math::BoundingBox(position,
+		                                    position + math::Vec3f(1.0f, 1.0f, 1.0f)));
+	}
+	// Camera looking along the negative z axis
+	math::Vec3f camerapos(0.0f, 1.7f, 0.0f);
+	math::Mat4f viewmat = math::Mat4f::TransMat(-camerapos.x, -camerapos.y, -camerapos.z);
+	math::Mat4f projmat = getPerspective(90.0f, 2.0f, 0.5f, 1000.0f);
+	math::Mat4f viewprojmat = projmat * viewmat;
+	render::OcclusionBuffer buffer(256, 128);
+	// Rasterize the occluders
+	Duration rastertime = Duration::Nanoseconds(0);
+	for (unsigned int frame = 0; frame < FRAMES; frame++)
+	{
+		Time start = Time::Now();
+		buffer.clear(viewprojmat);
+		for (unsigned int i = 0; i < occludermatrices.size(); i++)
+			buffer.drawOccluder(positions, 8, indices, 36, occludermatrices[i]);
+		buffer.buildHierarchy();
+		Time end = Time::Now();
+		rastertime += end - start;
+	}
+	// Test the objects
+	Duration testtime = Duration::Nanoseconds(0);
+	std::vector<bool> visible(objects.size());
+	for (unsigned int frame = 0; frame < FRAMES; frame++)
+	{
+		Time start = Time::Now();
+		for (unsigned int i = 0; i < objects.size(); i++)
+			visible[i] = buffer.isVisible(objects[i]);
+		Time end = Time::Now();
+		testtime += end - start;
+	}
+	// Objects in front of the camera on the street cannot be hidden, an
+	// object right behind the first building has to be hidden
+	if (!buffer.isVisible(math::BoundingBox(math::Vec3f(-0.5f, 0.0f, -20.0f),
+	                                        math::Vec3f(0.5f, 1.0f, -19.0f))))
+	{
+		std::cout << "Object on the street was culled." << std::endl;
+		errorcount++;
+	}
+	if (buffer.isVisible(math::BoundingBox(math::Vec3f(-14.0f, 0.0f, -18.0f),
+	                                       math::Vec3f(-13.0f, 1.0f, -17.0f))))
+	{
+		std::cout << "Object behind a building was not culled." << std::endl;
+		errorcount++;
+	}
+	// Instanced objects, only the instance on the street is visible
+	math::BoundingBox unitbox(math::Vec3f(0.0f, 0.0f, 0.0f),
+	                          math::Vec3f(1.0f, 1.0f, 1.0f));
+	math::Mat4f instances[2];
+	instances[0] = math::Mat4f::TransMat(-14.0f, 0.0f, -18.0f);
+	instances[1] = math::Mat4f::TransMat(-0.5f, 0.0f, -20.0f);
+	if (buffer.cullInstances(unitbox, instances, 2, instances) != 1
+	 || instances[0].m[12] != -0.5f)
+	{
+		std::cout << "Instances were not culled correctly." << std::endl;
+		errorcount++;
+	}
+	// Culled objects have to be hidden, check that the line of sight to
+	// their center is blocked by a building. Objects which are only visible
+	// in a fraction of a pixel can be culled, so a few mismatches are
+	// allowed.
+	unsigned int culledcount = 0;
+	unsigned int wrongcount = 0;
+	for (unsigned int i = 0; i < objects.size(); i++)
+	{
+		if (visible[i])
+			continue;
+		culledcount++;
+		math::Vec3f center = (objects[i].minCorner + objects[i].maxCorner) * 0.5f;
+		bool blocked = false;
+		for (unsigned int j = 0; j < buildings.size() && !blocked; j++)
+			blocked = intersectsBox(camerapos, center, buildings[j]);
+		if (!blocked)
+			wrongcount++;
+	}
+	if (wrongcount * 200 > culledcount)
+	{
+		std::cout << wrongcount << " of " << culledcount
+			<< " culled objects are not hidden." << std::endl;
+		errorcount++;
+	}
+	double rastermilliseconds = rastertime.getNanoseconds() * 1.0e-6 / FRAMES;
+	double testmilliseconds = testtime.getNanoseconds() * 1.0e-6;
+	std::cout << buildings.size() << " occluders ("
+		<< buffer.getOccluderTriangleCount() << " triangles drawn): "
+		<< rastermilliseconds << " ms per frame." << std::endl;
+	std::cout << objects.size() << " objects (" << culledcount << " culled, "
+		<< wrongcount << " visible centers): "
+		<< (double)objects.size() * FRAMES / testmilliseconds
+		<< " tests/ms." << std::endl;
+	std::cout << errorcount << " errors." << std::endl;
+	return errorcount;
+}
@@ -0,0 +1,141 @@
+#include "CoreRender/scene/SpatialIndex.hpp"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace cr;
+using namespace scene;
+
+class Collector
+{
+	public:
+		void operator()(unsigned int userdata)
+		{
+			found.push_back(userdata);
+		}
+
+		std::vector<unsigned int> found;
+};
+
+static math::BoundingBox randomBox()
+{
+	math::Vec3f position((float)(std::rand() % 400) - 200.0f,
+	                     (float)(std::rand() % 400) - 200.0f,
+	                     (float)(std::rand() % 400) - 200.0f);
+	math::Vec3f size(1.0f + std::rand() % 4,
+	                 1.0f + std::rand() % 4,
+	                 1.0f + std::rand() % 4);
+	return math::BoundingBox(position - size, position + size);
+}
+
+static unsigned int checkQuery(const SpatialIndex &index,
+                               const render::Frustum &frustum,
+                               const std::vector<math::BoundingBox> &boxes,
+                               const std::vector<int> &leaves)
+{
+	Collector collector;
+	index.query(frustum, collector);
+	std::sort(collector.found.begin(), collector.found.end());
+	// Every visible object has to be returned, the index may return a few
+	// more objects because of the enlarged leaf boxes
+	unsigned int errorcount = 0;
+	for (unsigned int i = 0; i < boxes.size(); i++)
+	{
+		if (leaves[i] == -1)
+		{
+			if (std::binary_search(collector.found.begin(), collector.found.end(), i))
+				errorcount++;
+			continue;
+		}
+		if (!frustum.isVisible(boxes[i], math::Mat4f::Identity()))
+			continue;
+		if (!std::binary_search(collector.found.begin(), collector.found.end(), i))
+			errorcount++;
+	}
+	if (errorcount != 0)
+		std::cout << errorcount << " objects were not found." << std::endl;
+	return errorcount;
+}
+
+static unsigned int checkHeight(const SpatialIndex &index, unsigned int limit)
+{
+	std::cout << "Tree height: " << index.getHeight() << std::endl;
+	if (index.getHeight() > limit)
+	{
+		std::cout << "The tree is not balanced, the height should be at most "
+			<< limit << "." << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+static unsigned int testGrid()
+{
+	// Levels are usually loaded in spatial order, which must not produce a
+	// degenerate tree
+	static const unsigned int GRID_SIZE = 100;
+	render::Frustum frustum;
+	frustum.setMatrix(math::Mat4f::ScaleMat(0.01f, 0.01f, 0.01f));
+	SpatialIndex index;
+	std::vector<math::BoundingBox> boxes(GRID_SIZE * GRID_SIZE);
+	std::vector<int> leaves(GRID_SIZE * GRID_SIZE);
+	for (unsigned int z = 0; z < GRID_SIZE; z++)
+	{
+		for (unsigned int x = 0; x < GRID_SIZE; x++)
+		{
+			unsigned int i = z * GRID_SIZE + x;
+			math::Vec3f position(x * 3.0f - 150.0f, 0.0f, z * 3.0f - 150.0f);
+			math::Vec3f size(1.0f, 1.0f, 1.0f);
+			boxes[i] = math::BoundingBox(position - size, position + size);
+			leaves[i] = index.insert(boxes[i], i);
+		}
+	}
+	unsigned int errorcount = checkHeight(index, 20);
+	errorcount += checkQuery(index, frustum, boxes, leaves);
+	return errorcount;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned int OBJECTS = 10000;
+	render::Frustum frustum;
+	frustum.setMatrix(math::Mat4f::ScaleMat(0.01f, 0.01f, 0.01f));
+	std::srand(42);
+	unsigned int errorcount = 0;
+	SpatialIndex index;
+	std::vector<math::BoundingBox> boxes(OBJECTS);
+	std::vector<int> leaves(OBJECTS);
+	for (unsigned int i = 0; i < OBJECTS; i++)
+	{
+		boxes[i] = randomBox();
+		leaves[i] = index.insert(boxes[i], i);
+	}
+	errorcount += checkHeight(index, 20);
+	errorcount += checkQuery(index, frustum, boxes, leaves);
+	// Move some of the objects by a small distance and some of them to a
+	// different place
+	for (unsigned int i = 0; i < OBJECTS; i += 3)
+	{
+		math::Vec3f offset(0.5f, -0.5f, 0.5f);
+		if (i % 2)
+			boxes[i] = math::BoundingBox(boxes[i].minCorner + offset,
+			                             boxes[i].maxCorner + offset);
+		else
+			boxes[i] = randomBox();
+		index.update(leaves[i], boxes[i]);
+	}
+	errorcount += checkQuery(index, frustum, boxes, leaves);
+	// Remove some objects
+	for (unsigned int i = 0; i < OBJECTS; i += 7)
+	{
+		index.remove(leaves[i]);
+		leaves[i] = -1;
+	}
+	errorcount += checkQuery(index, frustum, boxes, leaves);
+	errorcount += checkHeight(index, 20);
+	errorcount += testGrid();
+	std::cout << errorcount << " errors." << std::endl;
+	return errorcount;
+}
@@ -453,9 +453,9 @@ int main(int argc, char **argv)
 				}
 				for (unsigned int i = 0; i < 3; i++)
 				{
-					if (pos[i] < batch.boundingbox[i])
+					if (j == 0 || pos[i] < batch.boundingbox[i])
 						batch.boundingbox[i] = pos[i];
-					if (pos[i] > batch.boundingbox[i + 3])
+					if (j == 0 || pos[i] > batch.boundingbox[i + 3])
 						batch.boundingbox[i + 3] = pos[i];
 				}
 				pos = (float*)((char*)pos + batch.attribs.stride);
@@ -707,6 +707,7 @@ int main(int argc, char **argv)
 			GeometryFile::Batch &batch = output.batches[i];
 			file.write((char*)&batch.attribs, sizeof(batch.attribs));
 			file.write((char*)&batch.geom, sizeof(batch.geom));
+			file.write((char*)batch.boundingbox, sizeof(batch.boundingbox));
 			if (batch.geom.jointcount)
 				file.write((char*)&batch.jointmatrices[0],
 				           sizeof(float) * batch.geom.jointcount * 16);
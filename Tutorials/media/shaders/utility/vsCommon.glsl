@@ -19,7 +19,8 @@ vec4 getSkinningPos(vec4 pos)
 vec4 getWorldPos(vec4 pos)
 {
 #if Instancing
-	return transMat * pos;
+	// transMat contains the rows of the transformation matrix
+	return pos * transMat;
 #else
 	return worldMat * pos;
 #endif